@@ -0,0 +1,112 @@
+//
+// Created by Andreas Royset on 10/18/26.
+//
+
+#ifndef ACCUMBUFFER_H
+#define ACCUMBUFFER_H
+
+#include <cstdint>
+#include <vector>
+#include "float3.h"
+#include "int2.h"
+#include "Image.h"
+
+// Everything the renderer keeps per pixel in one 16 byte record, instead of
+// colorBuffer + sampleCount + prob spread over three allocations.
+struct AccumPixel {
+    float r, g, b;
+    uint32_t samples : 31;
+    uint32_t active : 1;
+};
+static_assert(sizeof(AccumPixel) == 16, "AccumPixel should pack into 16 bytes");
+
+class AccumBuffer {
+    int2 size;
+    std::vector<AccumPixel> storage;
+    AccumPixel* pixels = nullptr; // storage, or memory owned by someone else
+    size_t count = 0;
+
+    public:
+    AccumBuffer() = default;
+    explicit AccumBuffer(const int2 size) {
+        this->size = size;
+        count = size_t(size.x) * size.y;
+        storage.resize(count);
+        pixels = storage.data();
+        clear();
+    }
+    // Uses memory owned by someone else, like a mapped checkpoint file, and leaves its contents alone
+    AccumBuffer(const int2 size, AccumPixel* external) {
+        this->size = size;
+        count = size_t(size.x) * size.y;
+        pixels = external;
+    }
+    AccumBuffer(const AccumBuffer& other) : size(other.size), storage(other.storage), count(other.count) {
+        pixels = storage.empty() ? other.pixels : storage.data();
+    }
+    AccumBuffer(AccumBuffer&& other) noexcept = default;
+    AccumBuffer& operator=(const AccumBuffer& other) {
+        if (this != &other) *this = AccumBuffer(other);
+        return *this;
+    }
+    AccumBuffer& operator=(AccumBuffer&& other) noexcept = default;
+
+    void clear() {
+        for (size_t i = 0; i < count; i++) {
+            pixels[i] = {0, 0, 0, 0, 1};
+        }
+    }
+
+    // color is the sum of that many samples
+    void add(const int index, const float3 color, const int samples = 1) {
+        AccumPixel& pixel = pixels[index];
+        pixel.r += color.x;
+        pixel.g += color.y;
+        pixel.b += color.z;
+        pixel.samples += samples;
+    }
+    [[nodiscard]] bool isActive(const int index) const {
+        return pixels[index].active;
+    }
+    void deactivate(const int index) {
+        pixels[index].active = 0;
+    }
+    [[nodiscard]] int samples(const int index) const {
+        return int(pixels[index].samples);
+    }
+    [[nodiscard]] float3 average(const int index) const {
+        const AccumPixel& pixel = pixels[index];
+        if (pixel.samples == 0) return {};
+        const float inv = 1.0f / float(pixel.samples);
+        return {pixel.r * inv, pixel.g * inv, pixel.b * inv};
+    }
+
+    // sampleCount-divided radiance, same as colorBuffer.divide(sampleCount)
+    [[nodiscard]] Image averageImage() const {
+        Image image(size.x, size.y);
+        float* out = image.getData()->data();
+        for (size_t i = 0; i < count; i++) {
+            const float3 color = average(int(i));
+            out[i*3] = color.x;
+            out[i*3+1] = color.y;
+            out[i*3+2] = color.z;
+        }
+        return image;
+    }
+    [[nodiscard]] std::vector<float> activeMask() const {
+        std::vector<float> mask(count);
+        for (size_t i = 0; i < count; i++) {
+            mask[i] = float(pixels[i].active);
+        }
+        return mask;
+    }
+
+    [[nodiscard]] int2 getSize() const {
+        return size;
+    }
+    [[nodiscard]] const AccumPixel* data() const {
+        return pixels;
+    }
+};
+
+#endif //ACCUMBUFFER_H
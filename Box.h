@@ -15,15 +15,27 @@ private:
     float3 min_corner;
     float3 max_corner;
     Material* material;
-    HitInfo* collision;
 
 public:
     Box(const float3& min_corner, const float3& max_corner, Material* material)
         : min_corner(min_corner), max_corner(max_corner), material(material) {
-        collision = new HitInfo(material);
     }
 
-    [[nodiscard]] HitInfo* checkCollision(const float3& pos, const float3& dir, const float3& inv_dir) const override {
+    void hash(Hasher& hasher) const override {
+        hasher.add(std::string("box")).add(min_corner).add(max_corner);
+        material->hash(hasher);
+    }
+
+    bool flatten(Primitive& out, Material*& material) const override {
+        out.type = PrimitiveType::Box;
+        out.a = min_corner;
+        out.b = max_corner;
+        material = this->material;
+        return true;
+    }
+
+    // Slab test, shared with the BVH
+    static bool intersect(const float3& min_corner, const float3& max_corner, const float3& pos, const float3& inv_dir, float& t, float3& normal) {
         const float tx1 = (min_corner.x - pos.x) * inv_dir.x;
         const float tx2 = (max_corner.x - pos.x) * inv_dir.x;
         const float tx_min = std::min(tx1, tx2);
@@ -42,26 +54,27 @@ public:
         const float tmin = std::max(std::max(tx_min, ty_min), tz_min);
         const float tmax = std::min(std::min(tx_max, ty_max), tz_max);
 
-        if (tmax < 0.0f || tmin > tmax) {
-            collision->updateData(false);
-            return collision;
-        }
-
-        const float t_hit = (tmin > 0.01f) ? tmin : tmax;
+        if (tmax < 0.0f || tmin > tmax) return false;
 
-        if (t_hit < 0.01f) {
-            collision->updateData(false);
-            return collision;
-        }
+        t = (tmin > 0.01f) ? tmin : tmax;
+        if (t < 0.01f) return false;
 
-        float3 normal = {0, 0, 0};
+        normal = {0, 0, 0};
 
         constexpr  float eps = 1e-4f;
         if (std::abs(tmin - tx_min) < eps) normal = (inv_dir.x < 0.0f) ? float3(1, 0, 0) : float3(-1, 0, 0);
         else if (std::abs(tmin - ty_min) < eps) normal = (inv_dir.y < 0.0f) ? float3(0, 1, 0) : float3(0, -1, 0);
         else if (std::abs(tmin - tz_min) < eps) normal = (inv_dir.z < 0.0f) ? float3(0, 0, 1) : float3(0, 0, -1);
+        return true;
+    }
 
-        collision->updateData(true, t_hit, normal);
+    // A new HitInfo every time, the ray deletes it
+    [[nodiscard]] HitInfo* checkCollision(const float3& pos, const float3& dir, const float3& inv_dir) const override {
+        auto* collision = new HitInfo(material);
+        float t;
+        float3 normal;
+        if (intersect(min_corner, max_corner, pos, inv_dir, t, normal)) collision->updateData(true, t, normal);
+        else collision->updateData(false);
         return collision;
     }
 };
@@ -0,0 +1,326 @@
+//
+// Created by Andreas Royset on 10/18/26.
+//
+
+#ifndef BVH_H
+#define BVH_H
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "Box.h"
+#include "HitInfo.h"
+#include "Material.h"
+#include "Object.h"
+#include "Sphere.h"
+#include "float3.h"
+
+struct BvhNode {
+    float3 min;
+    uint32_t first; // first primitive of a leaf, left child of an inner node (right is first + 1)
+    float3 max;
+    uint32_t count; // primitives in a leaf, 0 for inner nodes
+};
+static_assert(sizeof(BvhNode) == 32, "BvhNode is stored in compiled scenes");
+
+namespace bvh {
+
+inline float3 minimum(const float3& a, const float3& b) {
+    return {std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z)};
+}
+inline float3 maximum(const float3& a, const float3& b) {
+    return {std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z)};
+}
+inline float axis(const float3& v, const int i) {
+    return i == 0 ? v.x : i == 1 ? v.y : v.z;
+}
+inline float area(const float3& min, const float3& max) {
+    const float3 e = max - min;
+    return e.x * e.y + e.y * e.z + e.z * e.x;
+}
+
+inline void bounds(const Primitive& primitive, float3& min, float3& max) {
+    if (primitive.type == PrimitiveType::Sphere) {
+        const float3 r(std::abs(primitive.b.x));
+        min = primitive.a - r;
+        max = primitive.a + r;
+    } else { // boxes may have their corners swapped
+        min = minimum(primitive.a, primitive.b);
+        max = maximum(primitive.a, primitive.b);
+    }
+}
+
+constexpr int maxDepth = 60;
+
+struct Builder {
+    std::vector<Primitive>& primitives;
+    std::vector<float3> mins, maxs, centers;
+    std::vector<BvhNode> nodes;
+
+    explicit Builder(std::vector<Primitive>& primitives) : primitives(primitives) {
+        for (const Primitive& primitive : primitives) {
+            float3 min, max;
+            bounds(primitive, min, max);
+            mins.push_back(min);
+            maxs.push_back(max);
+            centers.push_back((min + max) * 0.5f);
+        }
+    }
+
+    void swap(const uint32_t a, const uint32_t b) {
+        std::swap(primitives[a], primitives[b]);
+        std::swap(mins[a], mins[b]);
+        std::swap(maxs[a], maxs[b]);
+        std::swap(centers[a], centers[b]);
+    }
+
+    // Binned SAH split of node, recursing into both halves. Depth is capped so traversal
+    // fits in a fixed stack.
+    void split(const uint32_t index, const int depth = 0) {
+        constexpr int bins = 16;
+        const uint32_t first = nodes[index].first, count = nodes[index].count;
+        if (count <= 2 or depth >= maxDepth) return;
+
+        float3 centerMin = centers[first], centerMax = centers[first];
+        for (uint32_t i = first; i < first + count; i++) {
+            centerMin = minimum(centerMin, centers[i]);
+            centerMax = maximum(centerMax, centers[i]);
+        }
+
+        float bestCost = area(nodes[index].min, nodes[index].max) * float(count);
+        int bestAxis = -1;
+        float bestPlane = 0;
+        for (int a = 0; a < 3; a++) {
+            const float lo = axis(centerMin, a), hi = axis(centerMax, a);
+            if (hi <= lo) continue;
+            float3 binMin[bins], binMax[bins];
+            int binCount[bins] = {};
+            const float scale = float(bins) / (hi - lo);
+            for (uint32_t i = first; i < first + count; i++) {
+                const int b = std::min(bins - 1, int((axis(centers[i], a) - lo) * scale));
+                binMin[b] = binCount[b] == 0 ? mins[i] : minimum(binMin[b], mins[i]);
+                binMax[b] = binCount[b] == 0 ? maxs[i] : maximum(binMax[b], maxs[i]);
+                binCount[b]++;
+            }
+            // sweep from the left, then from the right, costing every plane between bins
+            float leftArea[bins - 1];
+            int leftCount[bins - 1];
+            float3 runMin, runMax;
+            int run = 0;
+            for (int b = 0; b < bins - 1; b++) {
+                if (binCount[b] > 0) {
+                    runMin = run == 0 ? binMin[b] : minimum(runMin, binMin[b]);
+                    runMax = run == 0 ? binMax[b] : maximum(runMax, binMax[b]);
+                    run += binCount[b];
+                }
+                leftArea[b] = run == 0 ? 0 : area(runMin, runMax);
+                leftCount[b] = run;
+            }
+            run = 0;
+            for (int b = bins - 1; b > 0; b--) {
+                if (binCount[b] > 0) {
+                    runMin = run == 0 ? binMin[b] : minimum(runMin, binMin[b]);
+                    runMax = run == 0 ? binMax[b] : maximum(runMax, binMax[b]);
+                    run += binCount[b];
+                }
+                if (run == 0 or leftCount[b - 1] == 0) continue;
+                const float cost = leftArea[b - 1] * float(leftCount[b - 1]) + area(runMin, runMax) * float(run);
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = a;
+                    bestPlane = lo + float(b) / scale;
+                }
+            }
+        }
+        if (bestAxis < 0) return; // a leaf is cheaper
+
+        uint32_t middle = first;
+        for (uint32_t i = first; i < first + count; i++) {
+            if (axis(centers[i], bestAxis) < bestPlane) swap(i, middle++);
+        }
+        if (middle == first or middle == first + count) return;
+
+        const auto left = uint32_t(nodes.size());
+        nodes.push_back(leaf(first, middle - first));
+        nodes.push_back(leaf(middle, first + count - middle));
+        nodes[index].first = left;
+        nodes[index].count = 0;
+        split(left, depth + 1);
+        split(left + 1, depth + 1);
+    }
+
+    [[nodiscard]] BvhNode leaf(const uint32_t first, const uint32_t count) const {
+        BvhNode node{mins[first], first, maxs[first], count};
+        for (uint32_t i = first; i < first + count; i++) {
+            node.min = minimum(node.min, mins[i]);
+            node.max = maximum(node.max, maxs[i]);
+        }
+        return node;
+    }
+};
+
+// Reorders primitives into leaf order and returns the nodes, the root is nodes[0]
+inline std::vector<BvhNode> build(std::vector<Primitive>& primitives) {
+    if (primitives.empty()) return {};
+    Builder builder(primitives);
+    builder.nodes.reserve(primitives.size() * 2);
+    builder.nodes.push_back(builder.leaf(0, uint32_t(primitives.size())));
+    builder.split(0);
+    return builder.nodes;
+}
+
+// Distance to where the ray enters the node, or a miss if that is not before limit
+inline bool enter(const BvhNode& node, const float3& pos, const float3& inv_dir, const float limit, float& t) {
+    const float tx1 = (node.min.x - pos.x) * inv_dir.x, tx2 = (node.max.x - pos.x) * inv_dir.x;
+    const float ty1 = (node.min.y - pos.y) * inv_dir.y, ty2 = (node.max.y - pos.y) * inv_dir.y;
+    const float tz1 = (node.min.z - pos.z) * inv_dir.z, tz2 = (node.max.z - pos.z) * inv_dir.z;
+    const float tmin = std::max(std::max(std::min(tx1, tx2), std::min(ty1, ty2)), std::min(tz1, tz2));
+    const float tmax = std::min(std::min(std::max(tx1, tx2), std::max(ty1, ty2)), std::max(tz1, tz2));
+    t = tmin;
+    return tmax >= std::max(tmin, 0.0f) and tmin < limit;
+}
+
+} // namespace bvh
+
+// All flattenable objects of a scene behind one bounding volume hierarchy. Either owns its
+// arrays, built from Objects, or works in place on arrays owned by someone else, like a
+// mapped compiled scene.
+class BvhGeometry : public Object {
+    std::vector<Material> ownedMaterials;
+    std::vector<Primitive> ownedPrimitives;
+    std::vector<BvhNode> ownedNodes;
+
+    Material* materials = nullptr;
+    const Primitive* primitives = nullptr;
+    const BvhNode* nodes = nullptr;
+    size_t materialCount = 0, primitiveCount = 0, nodeCount = 0;
+    std::vector<uint32_t> ids; // per primitive, from its shape so they don't depend on the build order
+
+    void identify() {
+        ids.resize(primitiveCount);
+        for (size_t i = 0; i < primitiveCount; i++) {
+            const Primitive& primitive = primitives[i];
+            ids[i] = hashId(Hasher().add(int(primitive.type)).add(primitive.a).add(primitive.b).get());
+        }
+    }
+
+    public:
+    // Objects that can't be flattened are handed back in rest
+    BvhGeometry(const std::vector<Object*>& bodies, std::vector<Object*>& rest) {
+        std::unordered_map<const Material*, uint32_t> materialIndex;
+        for (Object* body : bodies) {
+            Primitive primitive{};
+            Material* material = nullptr;
+            if (!body->flatten(primitive, material)) {
+                rest.push_back(body);
+                continue;
+            }
+            const auto it = materialIndex.find(material);
+            if (it != materialIndex.end()) {
+                primitive.material = it->second;
+            } else {
+                primitive.material = uint32_t(ownedMaterials.size());
+                materialIndex[material] = primitive.material;
+                ownedMaterials.push_back(*material);
+            }
+            ownedPrimitives.push_back(primitive);
+        }
+        ownedNodes = bvh::build(ownedPrimitives);
+
+        materials = ownedMaterials.data();
+        primitives = ownedPrimitives.data();
+        nodes = ownedNodes.data();
+        materialCount = ownedMaterials.size();
+        primitiveCount = ownedPrimitives.size();
+        nodeCount = ownedNodes.size();
+        identify();
+    }
+
+    BvhGeometry(Material* materials, const size_t materialCount, const Primitive* primitives, const size_t primitiveCount,
+                const BvhNode* nodes, const size_t nodeCount)
+        : materials(materials), primitives(primitives), nodes(nodes),
+          materialCount(materialCount), primitiveCount(primitiveCount), nodeCount(nodeCount) {
+        identify();
+    }
+
+    [[nodiscard]] HitInfo* checkCollision(const float3& pos, const float3& dir, const float3& inv_dir) const override {
+        auto bestT = float(pow(10, 10));
+        const Primitive* best = nullptr;
+        float3 bestNormal;
+
+        uint32_t stack[bvh::maxDepth + 2];
+        int top = 0;
+        float t;
+        if (nodeCount > 0 and bvh::enter(nodes[0], pos, inv_dir, bestT, t)) stack[top++] = 0;
+        while (top > 0) {
+            const BvhNode& node = nodes[stack[--top]];
+            if (node.count > 0) {
+                for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                    const Primitive& primitive = primitives[i];
+                    float3 normal;
+                    const bool hit = primitive.type == PrimitiveType::Sphere ?
+                        Sphere::intersect(primitive.a, primitive.b.x, pos, dir, t, normal) :
+                        Box::intersect(primitive.a, primitive.b, pos, inv_dir, t, normal);
+                    if (hit and t < bestT) {
+                        bestT = t;
+                        best = &primitive;
+                        bestNormal = normal;
+                    }
+                }
+                continue;
+            }
+            // push the far child first so the near one is visited first
+            float tLeft, tRight;
+            const bool left = bvh::enter(nodes[node.first], pos, inv_dir, bestT, tLeft);
+            const bool right = bvh::enter(nodes[node.first + 1], pos, inv_dir, bestT, tRight);
+            if (left and right) {
+                const bool leftFirst = tLeft <= tRight;
+                stack[top++] = leftFirst ? node.first + 1 : node.first;
+                stack[top++] = leftFirst ? node.first : node.first + 1;
+            } else if (left) {
+                stack[top++] = node.first;
+            } else if (right) {
+                stack[top++] = node.first + 1;
+            }
+        }
+
+        if (best == nullptr) {
+            auto* miss = new HitInfo(nullptr);
+            miss->updateData(false);
+            return miss;
+        }
+        auto* hit = new HitInfo(&materials[best->material]);
+        hit->updateData(true, bestT, bestNormal);
+        hit->setObject(ids[best - primitives]);
+        return hit;
+    }
+
+    void hash(Hasher& hasher) const override {
+        hasher.add(std::string("bvh"));
+        for (size_t i = 0; i < primitiveCount; i++) {
+            const Primitive& primitive = primitives[i];
+            hasher.add(int(primitive.type)).add(primitive.a).add(primitive.b);
+            materials[primitive.material].hash(hasher);
+        }
+    }
+
+    void lights(std::vector<SphereLight>& out) const override {
+        for (size_t i = 0; i < primitiveCount; i++) {
+            const Primitive& primitive = primitives[i];
+            const Material* material = &materials[primitive.material];
+            if (primitive.type == PrimitiveType::Sphere and material->emission_color.mag() > 0) {
+                out.push_back({primitive.a, primitive.b.x, material});
+            }
+        }
+    }
+
+    [[nodiscard]] const Material* getMaterials() const { return materials; }
+    [[nodiscard]] const Primitive* getPrimitives() const { return primitives; }
+    [[nodiscard]] const BvhNode* getNodes() const { return nodes; }
+    [[nodiscard]] size_t getMaterialCount() const { return materialCount; }
+    [[nodiscard]] size_t getPrimitiveCount() const { return primitiveCount; }
+    [[nodiscard]] size_t getNodeCount() const { return nodeCount; }
+};
+
+#endif //BVH_H
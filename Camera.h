@@ -5,7 +5,9 @@
 #ifndef CAMERA_H
 #define CAMERA_H
 
+#include "float2.h"
 #include "float3.h"
+#include "Hash.h"
 #include <functional>
 
 class Camera {
@@ -57,6 +59,40 @@ class Camera {
 
         return false;
     }
+
+    // Where a point of a width x height image sits on the screen plane: x runs from aspect on
+    // the left to -aspect on the right, y from 1 at the top to -1 at the bottom
+    [[nodiscard]] static float2 toScreen(const float2& pixel, const int width, const int height) {
+        const float aspect_ratio = float(width)/float(height);
+        constexpr float scale = 1.0f;//tanf((fov * 0.5f) * (float(M_PI) / 180.0f)); // fov to scale
+        return {(1.0f - 2.0f * (pixel.x / float(width))) * (aspect_ratio * scale), (1.0f - 2.0f * (pixel.y / float(height))) * scale};
+    }
+    // The image point toScreen maps to screen
+    [[nodiscard]] static float2 toPixel(const float2& screen, const int width, const int height) {
+        const float aspect_ratio = float(width)/float(height);
+        return {(1.0f - screen.x / aspect_ratio) * 0.5f * float(width), (1.0f - screen.y) * 0.5f * float(height)};
+    }
+
+    // Direction through a point on the screen plane one unit ahead, x along right and y along up
+    [[nodiscard]] float3 direction(const float2& screen) const {
+        return (forward + right * screen.x + up * screen.y).normalize();
+    }
+    // The screen point direction() would aim through point, false if it is behind the camera.
+    // up isn't square to forward, so this solves forward, right and up as a 3x3 system.
+    [[nodiscard]] bool project(const float3& point, float2& screen) const {
+        const float3 v = point - position;
+        const float3 rightUp = right.cross(up);
+        const float det = forward.dot(rightUp);
+        const float ahead = v.dot(rightUp) / det;
+        if (ahead <= 0) return false;
+        screen = {v.dot(up.cross(forward)) / det / ahead, v.dot(forward.cross(right)) / det / ahead};
+        return true;
+    }
+
+    // The pose of the current frame, the path itself can't be hashed
+    void hash(Hasher& hasher) const {
+        hasher.add(position).add(target).add(frameCount).add(frameRate);
+    }
 };
 
 #endif //CAMERA_H
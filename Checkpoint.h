@@ -0,0 +1,91 @@
+//
+// Created by Andreas Royset on 10/18/26.
+//
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include "AccumBuffer.h"
+#include "MappedFile.h"
+#include "int2.h"
+
+struct CheckpointHeader {
+    char magic[8];
+    uint32_t version;
+    int32_t width, height;
+    int32_t frame;
+    uint64_t sceneHash;
+    int32_t iteration; // iterations fully added to the pixels
+    uint32_t rngState; // sampler seed of the run, rendering doesn't advance it
+    uint32_t resumes;
+    uint8_t reserved[20];
+};
+static_assert(sizeof(CheckpointHeader) == 64, "CheckpointHeader should be 64 bytes");
+
+// The packed accumulation buffer of one frame, kept in a memory mapped file so a killed
+// render can carry on where it stopped. The file is a CheckpointHeader followed by the
+// AccumPixels. Samples from an iteration that was interrupted stay in the pixels; they are
+// valid samples, only the iteration count is not advanced for them. The rng is reseeded on
+// every resume so that iteration is not traced again with the same random numbers.
+class Checkpoint {
+    MappedFile file;
+    static constexpr char magic[8] = {'R', 'T', 'C', 'K', 'P', 'T', 0, 0};
+    static constexpr uint32_t version = 1;
+
+    public:
+    // Maps path for a frame of the given size. Returns true if the file already held this
+    // frame of this scene, otherwise it is reset to zero iterations and cleared pixels.
+    // Check isOpen() afterwards, the file may not be mappable.
+    bool open(const std::string& path, const int2 size, const uint64_t sceneHash, const int frame) {
+        const size_t pixelCount = size_t(size.x) * size.y;
+        const long long previous = file.open(path, sizeof(CheckpointHeader) + pixelCount * sizeof(AccumPixel));
+        if (previous < 0) return false;
+
+        CheckpointHeader& h = header();
+        const bool matches = size_t(previous) == file.size() and
+            std::memcmp(h.magic, magic, sizeof(magic)) == 0 and h.version == version and
+            h.width == size.x and h.height == size.y and h.sceneHash == sceneHash and h.frame == frame;
+        if (matches) {
+            h.resumes++;
+            return true;
+        }
+
+        h = {};
+        std::memcpy(h.magic, magic, sizeof(magic));
+        h.version = version;
+        h.width = size.x;
+        h.height = size.y;
+        h.frame = frame;
+        h.sceneHash = sceneHash;
+        AccumBuffer(size, pixels()).clear();
+        file.flush(true);
+        return false;
+    }
+
+    [[nodiscard]] uint32_t resumedState() const {
+        return header().rngState + header().resumes * 0x9E3779B9u;
+    }
+
+    // Records that iteration is complete. flush also pushes the pages to disk.
+    void commit(const int iteration, const uint32_t rngState, const bool flush) {
+        CheckpointHeader& h = header();
+        h.iteration = iteration;
+        h.rngState = rngState;
+        if (flush) file.flush();
+    }
+
+    [[nodiscard]] CheckpointHeader& header() const {
+        return *static_cast<CheckpointHeader*>(file.data());
+    }
+    [[nodiscard]] AccumPixel* pixels() const {
+        return reinterpret_cast<AccumPixel*>(static_cast<char*>(file.data()) + sizeof(CheckpointHeader));
+    }
+    [[nodiscard]] bool isOpen() const {
+        return file.isOpen();
+    }
+};
+
+#endif //CHECKPOINT_H
@@ -0,0 +1,253 @@
+//
+// Created by Andreas Royset on 10/18/26.
+//
+
+#ifndef COMPILEDSCENE_H
+#define COMPILEDSCENE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "Bvh.h"
+#include "Hash.h"
+#include "MappedFile.h"
+#include "SceneParser.h"
+
+// Layout of a compiled scene: this header, then the materials, primitives (in BVH leaf
+// order), BVH nodes and camera keys as flat arrays, each starting on a 64 byte boundary.
+// Everything is stored exactly as it sits in memory, so a loaded file is used in place.
+// Bump version whenever one of the stored structs changes.
+struct CompiledSceneHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t endian; // 0x01020304 as written by the compiling machine
+    uint32_t structSizes[6]; // Material, Primitive, BvhNode, RenderSettings, CameraPath, CameraKey
+    uint64_t sourceHash; // of the text scene, open() refuses the file once the scene next to it differs
+
+    RenderSettings settings;
+    CameraPath camera;
+
+    int32_t floorActive;
+    float floorHeight, floorChecker;
+    uint32_t floorMaterial1, floorMaterial2; // indices into the materials
+
+    int32_t skyActive;
+    float3 sun, sunColor, skyColor1, skyColor2;
+
+    uint64_t materialOffset, materialCount;
+    uint64_t primitiveOffset, primitiveCount;
+    uint64_t nodeOffset, nodeCount;
+    uint64_t keyOffset, keyCount;
+};
+
+namespace compiled_scene {
+
+constexpr char magic[8] = {'R', 'T', 'S', 'C', 'E', 'N', 'E', 0};
+constexpr uint32_t version = 7;
+constexpr uint32_t endian = 0x01020304;
+
+static_assert(std::is_trivially_copyable_v<Material> and std::is_trivially_copyable_v<Primitive> and
+    std::is_trivially_copyable_v<BvhNode> and std::is_trivially_copyable_v<RenderSettings> and
+    std::is_trivially_copyable_v<CameraPath> and std::is_trivially_copyable_v<CameraKey>,
+    "compiled scenes store these structs as raw bytes");
+
+inline void structSizes(uint32_t* sizes) {
+    sizes[0] = sizeof(Material);
+    sizes[1] = sizeof(Primitive);
+    sizes[2] = sizeof(BvhNode);
+    sizes[3] = sizeof(RenderSettings);
+    sizes[4] = sizeof(CameraPath);
+    sizes[5] = sizeof(CameraKey);
+}
+
+inline uint64_t align(const uint64_t offset) {
+    return (offset + 63) & ~uint64_t(63);
+}
+
+} // namespace compiled_scene
+
+// Parses a text scene, builds its BVH and writes the result to output
+inline bool compileScene(const std::string& input, const std::string& output) {
+    std::ifstream source(input, std::ios::binary);
+    if (!source) {
+        std::cerr << "Failed to open scene " << input << std::endl;
+        return false;
+    }
+    const std::string text((std::istreambuf_iterator<char>(source)), std::istreambuf_iterator<char>());
+    SceneParser parser;
+    if (!parser.parse(text, input)) return false;
+
+    std::vector<Object*> rest;
+    const BvhGeometry geometry(parser.bodies, rest);
+    if (!rest.empty()) {
+        std::cerr << input << ": " << rest.size() << " objects can't be compiled" << std::endl;
+        return false;
+    }
+
+    // the floor materials go after the ones the primitives use
+    std::vector<Material> materials(geometry.getMaterials(), geometry.getMaterials() + geometry.getMaterialCount());
+    materials.push_back(*parser.floor->material1);
+    materials.push_back(*parser.floor->material2);
+
+    CompiledSceneHeader header{};
+    std::memcpy(header.magic, compiled_scene::magic, sizeof(header.magic));
+    header.version = compiled_scene::version;
+    header.endian = compiled_scene::endian;
+    compiled_scene::structSizes(header.structSizes);
+    header.sourceHash = Hasher().add(text).get();
+    header.settings = parser.settings;
+    header.camera = parser.camera;
+    header.floorActive = parser.floor->active;
+    header.floorHeight = parser.floor->height;
+    header.floorChecker = parser.floor->checkerboard_size;
+    header.floorMaterial1 = uint32_t(materials.size() - 2);
+    header.floorMaterial2 = uint32_t(materials.size() - 1);
+    header.skyActive = parser.sky->active;
+    header.sun = parser.sky->sun_dir;
+    header.sunColor = parser.sky->sun_color;
+    header.skyColor1 = parser.sky->color1;
+    header.skyColor2 = parser.sky->color2;
+
+    header.materialCount = materials.size();
+    header.primitiveCount = geometry.getPrimitiveCount();
+    header.nodeCount = geometry.getNodeCount();
+    header.keyCount = parser.keys.size();
+    header.materialOffset = compiled_scene::align(sizeof(CompiledSceneHeader));
+    header.primitiveOffset = compiled_scene::align(header.materialOffset + header.materialCount * sizeof(Material));
+    header.nodeOffset = compiled_scene::align(header.primitiveOffset + header.primitiveCount * sizeof(Primitive));
+    header.keyOffset = compiled_scene::align(header.nodeOffset + header.nodeCount * sizeof(BvhNode));
+    const uint64_t fileSize = header.keyOffset + header.keyCount * sizeof(CameraKey);
+
+    std::vector<char> bytes(fileSize, 0);
+    std::memcpy(bytes.data(), &header, sizeof(header));
+    std::memcpy(bytes.data() + header.materialOffset, materials.data(), materials.size() * sizeof(Material));
+    std::memcpy(bytes.data() + header.primitiveOffset, geometry.getPrimitives(), header.primitiveCount * sizeof(Primitive));
+    std::memcpy(bytes.data() + header.nodeOffset, geometry.getNodes(), header.nodeCount * sizeof(BvhNode));
+    std::memcpy(bytes.data() + header.keyOffset, parser.keys.data(), header.keyCount * sizeof(CameraKey));
+
+    std::ofstream file(output, std::ios::binary);
+    file.write(bytes.data(), std::streamsize(bytes.size()));
+    if (!file) {
+        std::cerr << "Failed to write " << output << std::endl;
+        return false;
+    }
+    std::cout << "Compiled " << input << " to " << output << ": " << header.primitiveCount << " primitives, "
+              << header.nodeCount << " nodes, " << header.materialCount << " materials" << std::endl;
+    return true;
+}
+
+// A compiled scene mapped copy on write. The Scene it makes points into the mapping and at
+// the geometry, floor and sky kept here, so this has to outlive it.
+class CompiledScene {
+    MappedFile file;
+    std::unique_ptr<BvhGeometry> geometry;
+    std::unique_ptr<Floor> floor;
+    std::unique_ptr<Sky> sky;
+
+    public:
+    // True if path starts with the compiled scene magic
+    static bool isCompiled(const std::string& path) {
+        std::ifstream file(path, std::ios::binary);
+        char start[sizeof(compiled_scene::magic)] = {};
+        file.read(start, sizeof(start));
+        return file and std::memcmp(start, compiled_scene::magic, sizeof(start)) == 0;
+    }
+
+    bool open(const std::string& path) {
+        const long long bytes = file.openRead(path, true);
+        if (bytes < 0) return false;
+
+        const auto fail = [&](const std::string& why) {
+            std::cerr << path << ": " << why << ", compile it again" << std::endl;
+            file.close();
+            return false;
+        };
+        if (size_t(bytes) < sizeof(CompiledSceneHeader)) return fail("truncated");
+        const CompiledSceneHeader& h = header();
+        uint32_t sizes[6];
+        compiled_scene::structSizes(sizes);
+        if (std::memcmp(h.magic, compiled_scene::magic, sizeof(h.magic)) != 0) return fail("not a compiled scene");
+        if (h.version != compiled_scene::version) return fail("version " + std::to_string(h.version) + " instead of " + std::to_string(compiled_scene::version));
+        if (h.endian != compiled_scene::endian or std::memcmp(h.structSizes, sizes, sizeof(sizes)) != 0) return fail("compiled for a different platform");
+        // every array inside the file, without overflowing, and aligned for the struct it holds
+        const auto fits = [&](const uint64_t offset, const uint64_t count, const size_t size, const size_t alignment) {
+            return offset <= uint64_t(bytes) and count <= (uint64_t(bytes) - offset) / size and offset % alignment == 0;
+        };
+        if (!fits(h.materialOffset, h.materialCount, sizeof(Material), alignof(Material)) or
+            !fits(h.primitiveOffset, h.primitiveCount, sizeof(Primitive), alignof(Primitive)) or
+            !fits(h.nodeOffset, h.nodeCount, sizeof(BvhNode), alignof(BvhNode)) or
+            !fits(h.keyOffset, h.keyCount, sizeof(CameraKey), alignof(CameraKey)) or
+            h.floorMaterial1 >= h.materialCount or h.floorMaterial2 >= h.materialCount) return fail("corrupt");
+        if (!validGeometry()) return fail("corrupt geometry");
+        if (const char* problem = h.settings.invalid()) return fail(std::string("corrupt settings, ") + problem);
+
+        // the text scene it was compiled from, if it still sits next to it under the same name
+        const std::filesystem::path source = std::filesystem::path(path).replace_extension(".scene");
+        std::ifstream text(source, std::ios::binary);
+        if (text and Hasher().add(std::string((std::istreambuf_iterator<char>(text)), std::istreambuf_iterator<char>())).get() != h.sourceHash) {
+            return fail("older than " + source.string());
+        }
+
+        char* base = static_cast<char*>(file.data());
+        auto* materials = reinterpret_cast<Material*>(base + h.materialOffset);
+        const auto* primitives = reinterpret_cast<const Primitive*>(base + h.primitiveOffset);
+        const auto* nodes = reinterpret_cast<const BvhNode*>(base + h.nodeOffset);
+        geometry = std::make_unique<BvhGeometry>(materials, h.materialCount, primitives, h.primitiveCount, nodes, h.nodeCount);
+        floor = std::make_unique<Floor>(h.floorActive, h.floorHeight, &materials[h.floorMaterial1], &materials[h.floorMaterial2], h.floorChecker);
+        sky = std::make_unique<Sky>(h.skyActive, h.sun, h.sunColor, h.skyColor1, h.skyColor2);
+        return true;
+    }
+
+    // Indices in the mapped arrays stay inside them, and the BVH is a tree no deeper than
+    // traversal's fixed stack. Children always come after their parent, as the builder lays
+    // them out, which also rules out cycles.
+    [[nodiscard]] bool validGeometry() const {
+        const CompiledSceneHeader& h = header();
+        const char* base = static_cast<const char*>(file.data());
+        const auto* primitives = reinterpret_cast<const Primitive*>(base + h.primitiveOffset);
+        const auto* nodes = reinterpret_cast<const BvhNode*>(base + h.nodeOffset);
+
+        for (uint64_t i = 0; i < h.primitiveCount; i++) {
+            const Primitive& primitive = primitives[i];
+            if (primitive.material >= h.materialCount) return false;
+            if (primitive.type != PrimitiveType::Sphere and primitive.type != PrimitiveType::Box) return false;
+        }
+        std::vector<int> depths(h.nodeCount, 0);
+        for (uint64_t i = 0; i < h.nodeCount; i++) {
+            const BvhNode& node = nodes[i];
+            if (node.count > 0) {
+                if (uint64_t(node.first) + node.count > h.primitiveCount) return false;
+                continue;
+            }
+            if (node.first <= i or uint64_t(node.first) + 1 >= h.nodeCount) return false;
+            if (depths[i] + 1 > bvh::maxDepth) return false;
+            depths[node.first] = std::max(depths[node.first], depths[i] + 1);
+            depths[node.first + 1] = std::max(depths[node.first + 1], depths[i] + 1);
+        }
+        return true;
+    }
+
+    [[nodiscard]] const CompiledSceneHeader& header() const {
+        return *static_cast<const CompiledSceneHeader*>(file.data());
+    }
+    [[nodiscard]] const RenderSettings& settings() const {
+        return header().settings;
+    }
+
+    // No parsing and no BVH build, the geometry works on the mapped arrays. Scenes made from
+    // one file share its geometry.
+    [[nodiscard]] Scene makeScene() const {
+        const CompiledSceneHeader& h = header();
+        const auto* keys = reinterpret_cast<const CameraKey*>(static_cast<const char*>(file.data()) + h.keyOffset);
+        return ::makeScene(h.settings, makeCamera(h.camera, std::vector<CameraKey>(keys, keys + h.keyCount)), {geometry.get()}, floor.get(), sky.get());
+    }
+};
+
+#endif //COMPILEDSCENE_H
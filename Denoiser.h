@@ -0,0 +1,251 @@
+//
+// Created by Andreas Royset on 10/18/26.
+//
+
+#ifndef DENOISER_H
+#define DENOISER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "GuideBuffers.h"
+#include "Image.h"
+#include "Parallel.h"
+
+// Edge avoiding a-trous wavelet filter (Dammertz et al. 2010, "Edge-Avoiding A-Trous Wavelet
+// Transform for fast Global Illumination Filtering"). Each pass is a 5x5 B3 spline with its
+// taps twice as far apart as the last, weighted down across color, normal and depth edges.
+// The albedo is divided out first so only the lighting gets blurred.
+class Denoiser {
+    // One channel per plane, with a border wide enough for the widest pass so the inner loops
+    // run over contiguous memory without clamping, and vectorize
+    struct Planes {
+        int width = 0, height = 0, border = 0, stride = 0;
+        std::vector<float> data;
+
+        Planes(const int width, const int height, const int border, const int count)
+            : width(width), height(height), border(border), stride(width + 2 * border),
+              data(size_t(count) * stride * (height + 2 * border)) {}
+
+        [[nodiscard]] float* plane(const int p) {
+            return data.data() + size_t(p) * stride * (height + 2 * border);
+        }
+        [[nodiscard]] const float* plane(const int p) const {
+            return data.data() + size_t(p) * stride * (height + 2 * border);
+        }
+        // Where pixel 0 of row y starts
+        [[nodiscard]] size_t row(const int y) const {
+            return size_t(y + border) * stride + border;
+        }
+        // Copies the outermost pixels of plane p out over its border
+        void extend(const int p) {
+            float* values = plane(p);
+            for (int y = 0; y < height; y++) {
+                float* r = values + row(y);
+                std::fill(r - border, r, r[0]);
+                std::fill(r + width, r + width + border, r[width - 1]);
+            }
+            for (int y = 0; y < border; y++) {
+                std::copy_n(values + row(0) - border, stride, values + row(-1 - y) - border);
+                std::copy_n(values + row(height - 1) - border, stride, values + row(height + y) - border);
+            }
+        }
+    };
+    enum Plane { Red, Green, Blue, NormalX, NormalY, NormalZ, Depth, Mean, PlaneCount };
+
+    public:
+    int passes;
+    float colorSigma = 2.0f; // relative to the brightness around the pixel, halves every pass
+    float depthSigma = 0.02f; // relative depth change allowed per pixel of distance
+
+    static constexpr int maxPasses = 8; // taps 256 pixels apart
+
+    explicit Denoiser(const int passes = 5) : passes(std::clamp(passes, 0, maxPasses)) {}
+
+    // Filters the averaged frame in place
+    void apply(Image& image, const GuideBuffers& guides) const {
+        if (passes <= 0 or guides.empty()) return;
+        const int2 size = image.getSize();
+        float* pixels = image.getData()->data();
+        Planes planes(size.x, size.y, 2 << (passes - 1), PlaneCount);
+
+        parallelFor(size.y, [&](const int begin, const int end) {
+            for (int y = begin; y < end; y++) {
+                const size_t row = planes.row(y);
+                for (int x = 0; x < size.x; x++) {
+                    const int index = y * size.x + x;
+                    const float3 albedo = guides.albedo(index);
+                    const float3 normal = guides.normal(index);
+                    planes.plane(Red)[row + x] = pixels[index*3] / std::max(albedo.x, minAlbedo);
+                    planes.plane(Green)[row + x] = pixels[index*3+1] / std::max(albedo.y, minAlbedo);
+                    planes.plane(Blue)[row + x] = pixels[index*3+2] / std::max(albedo.z, minAlbedo);
+                    planes.plane(NormalX)[row + x] = normal.x;
+                    planes.plane(NormalY)[row + x] = normal.y;
+                    planes.plane(NormalZ)[row + x] = normal.z;
+                    planes.plane(Depth)[row + x] = guides.depth(index);
+                }
+            }
+        });
+        for (int p = 0; p < PlaneCount; p++) planes.extend(p);
+
+        Planes filtered(size.x, size.y, planes.border, 3);
+        for (int pass = 0; pass < passes; pass++) {
+            localMean(planes);
+            filterPass(planes, filtered, 1 << pass, colorSigma / float(1 << pass));
+            for (int c = 0; c < 3; c++) {
+                std::copy(filtered.plane(c), filtered.plane(c) + filtered.data.size() / 3, planes.plane(c));
+                planes.extend(c);
+            }
+        }
+
+        parallelFor(size.y, [&](const int begin, const int end) {
+            for (int y = begin; y < end; y++) {
+                const size_t row = planes.row(y);
+                for (int x = 0; x < size.x; x++) {
+                    const int index = y * size.x + x;
+                    const float3 albedo = guides.albedo(index);
+                    pixels[index*3] = planes.plane(Red)[row + x] * std::max(albedo.x, minAlbedo);
+                    pixels[index*3+1] = planes.plane(Green)[row + x] * std::max(albedo.y, minAlbedo);
+                    pixels[index*3+2] = planes.plane(Blue)[row + x] * std::max(albedo.z, minAlbedo);
+                }
+            }
+        });
+    }
+
+    private:
+    static constexpr float minAlbedo = 0.01f;
+    static constexpr int chunk = 128;
+    static constexpr int normalSquarings = 6; // the normal weight is the cosine between them to the 64th
+
+    // Float clamps on the bit patterns, for bounds of zero or more. Float min and max keep gcc from
+    // vectorizing the loop, like in linearizeFast.
+    static float atLeast(const float x, const float bound) {
+        int32_t bits, boundBits;
+        std::memcpy(&bits, &x, sizeof(bits));
+        std::memcpy(&boundBits, &bound, sizeof(boundBits));
+        bits = std::max(bits, boundBits);
+        float result;
+        std::memcpy(&result, &bits, sizeof(result));
+        return result;
+    }
+    static float atMost(const float x, const float bound) {
+        int32_t bits, boundBits;
+        std::memcpy(&bits, &x, sizeof(bits));
+        std::memcpy(&boundBits, &bound, sizeof(boundBits));
+        bits = std::min(bits, boundBits);
+        float result;
+        std::memcpy(&result, &bits, sizeof(result));
+        return result;
+    }
+
+    // Adds one tap, offset away from each pixel of a row, to the row's sums. The planes are
+    // passed from the center pixel of the row on, as plain pointers so the loop vectorizes,
+    // and the sums are restrict, too many pointers could overlap for gcc to check them all.
+    void tap(const float h, const float* r, const float* g, const float* b, const float* nx, const float* ny, const float* nz,
+             const float* depth, const ptrdiff_t offset, const float* colorScale, const float* depthScale,
+             float* __restrict sumR, float* __restrict sumG, float* __restrict sumB, float* __restrict sumW, const int width) const {
+        const float* rq = r + offset;
+        const float* gq = g + offset;
+        const float* bq = b + offset;
+        const float* nxq = nx + offset;
+        const float* nyq = ny + offset;
+        const float* nzq = nz + offset;
+        const float* depthq = depth + offset;
+        for (int x = 0; x < width; x++) {
+            const float dr = rq[x] - r[x], dg = gq[x] - g[x], db = bq[x] - b[x];
+            float normal = atLeast(nx[x] * nxq[x] + ny[x] * nyq[x] + nz[x] * nzq[x], 0.0f);
+            for (int i = 0; i < normalSquarings; i++) normal *= normal;
+            const float falloff = (dr * dr + dg * dg + db * db) * colorScale[x] + std::abs(depthq[x] - depth[x]) * depthScale[x];
+            // 2^-60 is as good as nothing, and stays clear of denormals and of fastExp2's -126 limit
+            const float w = h * normal * fastExp2(-atMost(falloff, 60.0f));
+            sumR[x] += w * rq[x];
+            sumG[x] += w * gq[x];
+            sumB[x] += w * bq[x];
+            sumW[x] += w;
+        }
+    }
+
+    // Luminance averaged over 3x3 pixels. The color weights scale with it rather than with the
+    // pixel itself, which would keep a dark outlier from taking in any of its neighbours.
+    static void localMean(Planes& planes) {
+        const float* r = planes.plane(Red);
+        const float* g = planes.plane(Green);
+        const float* b = planes.plane(Blue);
+        float* mean = planes.plane(Mean);
+        const ptrdiff_t stride = planes.stride;
+        parallelFor(planes.height, [&](const int begin, const int end) {
+            for (int y = begin; y < end; y++) {
+                const size_t row = planes.row(y);
+                for (int x = 0; x < planes.width; x++) {
+                    float sum = 0;
+                    for (ptrdiff_t dy = -1; dy <= 1; dy++) {
+                        for (ptrdiff_t dx = -1; dx <= 1; dx++) {
+                            const size_t q = size_t(ptrdiff_t(row + x) + dy * stride + dx);
+                            sum += 0.2126f * r[q] + 0.7152f * g[q] + 0.0722f * b[q];
+                        }
+                    }
+                    mean[row + x] = sum * (1.0f / 9);
+                }
+            }
+        });
+    }
+
+    void filterPass(const Planes& in, Planes& out, const int step, const float sigma) const {
+        constexpr float kernel[5] = {1.0f / 16, 1.0f / 4, 3.0f / 8, 1.0f / 4, 1.0f / 16};
+        constexpr float log2e = 1.44269504f;
+        const int width = in.width;
+        const float* r = in.plane(Red);
+        const float* g = in.plane(Green);
+        const float* b = in.plane(Blue);
+        const float* nx = in.plane(NormalX);
+        const float* ny = in.plane(NormalY);
+        const float* nz = in.plane(NormalZ);
+        const float* depth = in.plane(Depth);
+        const float* mean = in.plane(Mean);
+
+        parallelFor(in.height, [&](const int begin, const int end) {
+            std::vector<float> sumR(width), sumG(width), sumB(width), sumW(width), colorScale(width), depthScale(width);
+            for (int y = begin; y < end; y++) {
+                const size_t center = in.row(y);
+                for (int x = 0; x < width; x++) {
+                    const size_t p = center + x;
+                    const float spread = sigma * (mean[p] + 1.0f);
+                    colorScale[x] = log2e / (spread * spread);
+                    depthScale[x] = log2e / (depthSigma * float(step) * std::max(depth[p], 1e-3f));
+                }
+                std::fill(sumR.begin(), sumR.end(), 0.0f);
+                std::fill(sumG.begin(), sumG.end(), 0.0f);
+                std::fill(sumB.begin(), sumB.end(), 0.0f);
+                std::fill(sumW.begin(), sumW.end(), 0.0f);
+
+                // a chunk of the row at a time, so the center pixels stay in cache over all the taps
+                for (int x0 = 0; x0 < width; x0 += chunk) {
+                    const int count = std::min(chunk, width - x0);
+                    const size_t c = center + x0;
+                    for (int ky = -2; ky <= 2; ky++) {
+                        for (int kx = -2; kx <= 2; kx++) {
+                            const float h = kernel[ky + 2] * kernel[kx + 2];
+                            const ptrdiff_t offset = ptrdiff_t(ky * step) * in.stride + kx * step;
+                            tap(h, r + c, g + c, b + c, nx + c, ny + c, nz + c, depth + c, offset, colorScale.data() + x0, depthScale.data() + x0,
+                                sumR.data() + x0, sumG.data() + x0, sumB.data() + x0, sumW.data() + x0, count);
+                        }
+                    }
+                }
+
+                const size_t row = out.row(y);
+                for (int x = 0; x < width; x++) {
+                    // only a pixel without any samples, and so without a normal, has no weight at all
+                    const size_t p = center + x;
+                    const bool kept = sumW[x] > 0;
+                    const float inv = kept ? 1.0f / sumW[x] : 0.0f;
+                    out.plane(Red)[row + x] = kept ? sumR[x] * inv : r[p];
+                    out.plane(Green)[row + x] = kept ? sumG[x] * inv : g[p];
+                    out.plane(Blue)[row + x] = kept ? sumB[x] * inv : b[p];
+                }
+            }
+        });
+    }
+};
+
+#endif //DENOISER_H
@@ -7,6 +7,7 @@
 
 #include "float3.h"
 #include "Material.h"
+#include "Hash.h"
 
 class Floor{
   public:
@@ -28,6 +29,12 @@ class Floor{
         else {this->material2 = material2;}
         this->checkerboard_size = checkerboard_size;
     }
+
+    void hash(Hasher& hasher) const {
+        hasher.add(active).add(height).add(checkerboard_size);
+        material1->hash(hasher);
+        material2->hash(hasher);
+    }
 };
 
 #endif //FLOOR_H
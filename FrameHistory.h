@@ -0,0 +1,108 @@
+//
+// Created by Andreas Royset on 10/18/26.
+//
+
+#ifndef FRAMEHISTORY_H
+#define FRAMEHISTORY_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <optional>
+#include <vector>
+#include "Camera.h"
+#include "Image.h"
+#include "Parallel.h"
+#include "Scene.h"
+
+// The last frame's accumulation, carried into the next frame of an animation. Every pixel of
+// the new frame finds the point it sees in the old view and starts from the old average there,
+// as weight times the samples it had. Only holds for static geometry and lighting, and lags a
+// little on mirrors and glass, where what a pixel sees depends on where the camera is.
+class FrameHistory {
+    std::optional<Camera> camera;
+    int width = 0, height = 0;
+    Image average;
+    std::vector<int> samples;
+    std::vector<PixelVariance> variance;
+    std::vector<float> depths;
+    std::vector<uint32_t> objects;
+
+    public:
+    float weight; // share of the old samples a frame keeps, the history fades by it every frame
+    float depthTolerance = 0.05f; // relative, further apart the old pixel saw something else
+
+    explicit FrameHistory(const float weight) : weight(std::clamp(weight, 0.0f, 0.95f)) {}
+
+    [[nodiscard]] bool empty() const {
+        return !camera.has_value();
+    }
+
+    // Call once the frame is rendered, before anything filters its average. Needs the scene's
+    // guides for the depth.
+    void keep(const Scene& scene) {
+        if (weight <= 0 or scene.guides.empty()) return;
+        camera = scene.camera;
+        width = scene.width;
+        height = scene.height;
+        average = scene.averageImage();
+        samples.resize(size_t(width) * height);
+        depths.resize(samples.size());
+        objects.resize(samples.size());
+        for (int i = 0; i < width * height; i++) {
+            samples[i] = scene.samples(i);
+            depths[i] = scene.guides.depth(i);
+            objects[i] = scene.guides.object(i);
+        }
+        variance = scene.variance;
+    }
+
+    // Call after the frame's first iteration, whose first hits say where every pixel looks.
+    // Pixels whose point the old view didn't see, or saw behind something else, start cold.
+    // Returns how many pixels took history.
+    int apply(Scene& scene) const {
+        if (empty() or weight <= 0 or scene.guides.empty() or scene.width != width or scene.height != height) return 0;
+        std::vector<uint8_t> reused(size_t(width) * height, 0);
+
+        parallelFor(height, [&](const int begin, const int end) {
+            for (int y = begin; y < end; y++) {
+                for (int x = 0; x < width; x++) {
+                    const int index = y * width + x;
+                    // the point the pixel's center sees
+                    const float2 screen = Camera::toScreen({float(x), float(y)}, width, height);
+                    const float3 point = scene.camera.position + scene.camera.direction(screen) * scene.guides.depth(index);
+
+                    // and the old pixel it was in
+                    float2 old;
+                    if (!camera->project(point, old)) continue;
+                    const float2 oldPixel = Camera::toPixel(old, width, height);
+                    const int oldX = int(std::lround(oldPixel.x));
+                    const int oldY = int(std::lround(oldPixel.y));
+                    if (oldX < 0 or oldX >= width or oldY < 0 or oldY >= height) continue;
+                    const int oldIndex = oldY * width + oldX;
+
+                    // disoccluded, the old pixel saw another object or something nearer
+                    if (objects[oldIndex] != scene.guides.object(index)) continue;
+                    const float distance = (point - camera->position).mag();
+                    if (std::abs(distance - depths[oldIndex]) > depthTolerance * depths[oldIndex]) continue;
+
+                    const int carried = int(std::lround(weight * float(samples[oldIndex])));
+                    if (carried <= 0) continue;
+                    PixelVariance spread;
+                    if (!variance.empty() and variance[oldIndex].samples > 1) {
+                        const PixelVariance& was = variance[oldIndex];
+                        spread = {was.mean, was.m2 / float(was.samples - 1) * float(carried - 1), carried};
+                    }
+                    scene.addHistory(index, average.read(oldX, oldY), carried, spread);
+                    reused[index] = 1;
+                }
+            }
+        });
+
+        int count = 0;
+        for (const uint8_t pixel : reused) count += pixel;
+        return count;
+    }
+};
+
+#endif //FRAMEHISTORY_H
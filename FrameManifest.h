@@ -0,0 +1,54 @@
+//
+// Created by Andreas Royset on 10/18/26.
+//
+
+#ifndef FRAMEMANIFEST_H
+#define FRAMEMANIFEST_H
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+
+// Sidecar file next to the animation frames with one "frame hash" line per finished frame.
+// Lines are only ever appended, the last one for a frame wins, so a crash mid-write can at
+// worst lose the line of the frame being finished.
+class FrameManifest {
+    std::string path;
+    std::unordered_map<int, uint64_t> frames;
+
+    public:
+    explicit FrameManifest(std::string path) : path(std::move(path)) {
+        std::ifstream file(this->path);
+        std::string line;
+        while (std::getline(file, line)) {
+            std::istringstream stream(line);
+            int frame;
+            uint64_t hash;
+            if (stream >> frame >> std::hex >> hash) frames[frame] = hash;
+        }
+    }
+
+    // True if frame was finished with the same hash and its file is still there
+    [[nodiscard]] bool isDone(const int frame, const uint64_t hash, const std::string& filename) const {
+        const auto it = frames.find(frame);
+        return it != frames.end() and it->second == hash and std::filesystem::exists(filename);
+    }
+
+    // Call once the frame file is completely written
+    void record(const int frame, const uint64_t hash) {
+        frames[frame] = hash;
+        std::ofstream file(path, std::ios::app);
+        file << frame << " " << std::hex << hash << std::endl;
+        if (!file) std::cerr << "Failed to write " << path << std::endl;
+    }
+
+    [[nodiscard]] size_t size() const {
+        return frames.size();
+    }
+};
+
+#endif //FRAMEMANIFEST_H
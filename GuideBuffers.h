@@ -0,0 +1,82 @@
+//
+// Created by Andreas Royset on 10/18/26.
+//
+
+#ifndef GUIDEBUFFERS_H
+#define GUIDEBUFFERS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "float3.h"
+#include "Material.h"
+
+// What a camera ray hit first. albedo is the factor that bounce applied to the path, so a
+// filter can divide it out of the radiance and keep textures sharp. The ids are 0 for the sky.
+// The material is hashed into its id only when a pixel keeps it, not on every camera ray.
+struct FirstHit {
+    static constexpr float skyDepth = 1e6f;
+
+    float3 normal;
+    float3 albedo = float3(1);
+    float depth = skyDepth;
+    uint32_t object = 0;
+    const Material* material = nullptr;
+};
+
+// First hits summed over a frame's samples, for the denoiser and the AOV output. Ids can't be
+// averaged, a pixel keeps the ones its first sample hit.
+class GuideBuffers {
+    std::vector<float3> normals, albedos;
+    std::vector<float> depths;
+    std::vector<uint32_t> objects, materials;
+    std::vector<int> samples;
+
+    public:
+    // Empty buffers collect nothing
+    void reset(const size_t count) {
+        normals.assign(count, float3());
+        albedos.assign(count, float3());
+        depths.assign(count, 0);
+        objects.assign(count, 0);
+        materials.assign(count, 0);
+        samples.assign(count, 0);
+    }
+    void clear() {
+        reset(0);
+    }
+    [[nodiscard]] bool empty() const {
+        return samples.empty();
+    }
+
+    void add(const int index, const FirstHit& hit) {
+        normals[index] += hit.normal;
+        albedos[index] += hit.albedo;
+        depths[index] += hit.depth;
+        if (samples[index]++ == 0) {
+            objects[index] = hit.object;
+            materials[index] = hit.material ? hit.material->id() : 0;
+        }
+    }
+
+    // Averages, a pixel without samples reads as the sky
+    [[nodiscard]] float3 normal(const int index) const {
+        const float3 n = normals[index];
+        const float length = n.mag();
+        return length > 0 ? n / length : float3();
+    }
+    [[nodiscard]] float3 albedo(const int index) const {
+        return samples[index] > 0 ? albedos[index] / float(samples[index]) : float3(1);
+    }
+    [[nodiscard]] float depth(const int index) const {
+        return samples[index] > 0 ? depths[index] / float(samples[index]) : FirstHit::skyDepth;
+    }
+    [[nodiscard]] uint32_t object(const int index) const {
+        return objects[index];
+    }
+    [[nodiscard]] uint32_t material(const int index) const {
+        return materials[index];
+    }
+};
+
+#endif //GUIDEBUFFERS_H
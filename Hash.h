@@ -0,0 +1,56 @@
+//
+// Created by Andreas Royset on 10/18/26.
+//
+
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include "float3.h"
+
+// 64 bit FNV-1a, used to tell whether cached data on disk still belongs to the scene.
+class Hasher {
+    uint64_t value = 0xCBF29CE484222325ull;
+
+    public:
+    Hasher& bytes(const void* data, const size_t length) {
+        const auto* p = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < length; i++) {
+            value ^= p[i];
+            value *= 0x100000001B3ull;
+        }
+        return *this;
+    }
+    Hasher& add(const float f) {
+        return bytes(&f, sizeof(f));
+    }
+    Hasher& add(const int i) {
+        return bytes(&i, sizeof(i));
+    }
+    Hasher& add(const uint64_t u) {
+        return bytes(&u, sizeof(u));
+    }
+    Hasher& add(const bool b) {
+        return add(int(b));
+    }
+    Hasher& add(const float3& v) {
+        return add(v.x).add(v.y).add(v.z);
+    }
+    Hasher& add(const std::string& s) {
+        return add(int(s.size())).bytes(s.data(), s.size());
+    }
+
+    [[nodiscard]] uint64_t get() const {
+        return value;
+    }
+};
+
+// 24 bits of a hash and never 0, so ids stay exact when stored as floats and 0 can mean nothing
+inline uint32_t hashId(const uint64_t hash) {
+    const auto id = uint32_t(hash ^ (hash >> 24) ^ (hash >> 48)) & 0xFFFFFFu;
+    return id == 0 ? 1 : id;
+}
+
+#endif //HASH_H
@@ -0,0 +1,239 @@
+//
+// Created by Andreas Royset on 10/18/26.
+//
+
+#ifndef HDRWRITER_H
+#define HDRWRITER_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "AccumBuffer.h"
+#include "GuideBuffers.h"
+#include "Image.h"
+#include "half.h"
+#include "int2.h"
+
+// Pfm: portable float map, 32 bit rgb, bottom row first.
+// ExrHalf / ExrFloat: uncompressed scanline OpenEXR with half or float channels.
+// Every file is streamed one scanline at a time, nothing the size of the image is allocated.
+enum class HdrFormat { Pfm, ExrHalf, ExrFloat };
+
+inline std::string hdrExtension(const HdrFormat format) {
+    return format == HdrFormat::Pfm ? ".pfm" : ".exr";
+}
+
+// The tracer works in 0-255 radiance, HDR files are written with 1.0 as display white
+constexpr float hdrScale = 1.0f / 255.0f;
+
+namespace hdr {
+
+inline void put32(std::vector<unsigned char>& out, const uint32_t v) {
+    for (int i = 0; i < 4; i++) out.push_back((unsigned char)(v >> (8 * i)));
+}
+inline void putFloat(std::vector<unsigned char>& out, const float f) {
+    uint32_t bits;
+    std::memcpy(&bits, &f, sizeof(bits));
+    put32(out, bits);
+}
+inline void putHalf(std::vector<unsigned char>& out, const float f) {
+    const uint16_t bits = floatToHalf(f);
+    out.push_back((unsigned char)bits);
+    out.push_back((unsigned char)(bits >> 8));
+}
+inline void putAttribute(std::vector<unsigned char>& out, const std::string& name, const std::string& type, const std::vector<unsigned char>& value) {
+    out.insert(out.end(), name.begin(), name.end());
+    out.push_back(0);
+    out.insert(out.end(), type.begin(), type.end());
+    out.push_back(0);
+    put32(out, uint32_t(value.size()));
+    out.insert(out.end(), value.begin(), value.end());
+}
+
+struct ExrChannel {
+    std::string name;
+    int type; // 0 uint, 1 half, 2 float
+};
+
+// Writes an uncompressed scanline EXR. channels must be sorted by name, as the format requires.
+// value(x, y, channel) returns the sample of one channel, uint channels are rounded.
+template <typename Value>
+bool writeExr(const std::string& filename, const int2 size, const std::vector<ExrChannel>& channels, const Value& value) {
+    std::ofstream file(filename, std::ios::binary);
+    if (!file) {
+        std::cerr << "Failed to open " << filename << std::endl;
+        return false;
+    }
+
+    std::vector<unsigned char> header = {0x76, 0x2F, 0x31, 0x01, 2, 0, 0, 0}; // magic, version 2, scanline
+
+    std::vector<unsigned char> attribute;
+    size_t lineBytes = 0;
+    for (const ExrChannel& channel : channels) {
+        attribute.insert(attribute.end(), channel.name.begin(), channel.name.end());
+        attribute.push_back(0);
+        put32(attribute, channel.type);
+        put32(attribute, 0); // pLinear and reserved
+        put32(attribute, 1); // x sampling
+        put32(attribute, 1); // y sampling
+        lineBytes += size_t(size.x) * (channel.type == 1 ? 2 : 4);
+    }
+    attribute.push_back(0);
+    putAttribute(header, "channels", "chlist", attribute);
+    putAttribute(header, "compression", "compression", {0});
+    attribute.clear();
+    put32(attribute, 0);
+    put32(attribute, 0);
+    put32(attribute, size.x - 1);
+    put32(attribute, size.y - 1);
+    putAttribute(header, "dataWindow", "box2i", attribute);
+    putAttribute(header, "displayWindow", "box2i", attribute);
+    putAttribute(header, "lineOrder", "lineOrder", {0}); // increasing y
+    attribute.clear();
+    putFloat(attribute, 1);
+    putAttribute(header, "pixelAspectRatio", "float", attribute);
+    putAttribute(header, "screenWindowWidth", "float", attribute);
+    attribute.clear();
+    putFloat(attribute, 0);
+    putFloat(attribute, 0);
+    putAttribute(header, "screenWindowCenter", "v2f", attribute);
+    header.push_back(0);
+
+    // one scanline per chunk, so every offset is known up front
+    const uint64_t firstLine = header.size() + uint64_t(size.y) * 8;
+    for (int y = 0; y < size.y; y++) {
+        const uint64_t offset = firstLine + uint64_t(y) * (8 + lineBytes);
+        put32(header, uint32_t(offset));
+        put32(header, uint32_t(offset >> 32));
+    }
+    file.write(reinterpret_cast<const char*>(header.data()), std::streamsize(header.size()));
+
+    std::vector<unsigned char> line;
+    line.reserve(8 + lineBytes);
+    for (int y = 0; y < size.y; y++) {
+        line.clear();
+        put32(line, y);
+        put32(line, uint32_t(lineBytes));
+        for (int c = 0; c < int(channels.size()); c++) {
+            for (int x = 0; x < size.x; x++) {
+                const float v = value(x, y, c);
+                if (channels[c].type == 0) put32(line, uint32_t(std::lround(v))); // v + 0.5f rounds above 2^23
+                else if (channels[c].type == 1) putHalf(line, v);
+                else putFloat(line, v);
+            }
+        }
+        file.write(reinterpret_cast<const char*>(line.data()), std::streamsize(line.size()));
+    }
+    if (!file) std::cerr << "Failed to write " << filename << std::endl;
+    return bool(file);
+}
+
+// color(x, y, c) returns one channel of the pixel at (x, y), rows top first
+template <typename Color>
+bool writePfm(const std::string& filename, const int2 size, const Color& color) {
+    std::ofstream file(filename, std::ios::binary);
+    if (!file) {
+        std::cerr << "Failed to open " << filename << std::endl;
+        return false;
+    }
+    file << "PF\n" << size.x << " " << size.y << "\n-1.0\n"; // negative scale means little endian
+
+    std::vector<unsigned char> line;
+    line.reserve(size_t(size.x) * 12);
+    for (int y = size.y - 1; y >= 0; y--) {
+        line.clear();
+        for (int x = 0; x < size.x; x++) {
+            for (int c = 0; c < 3; c++) putFloat(line, color(x, y, c));
+        }
+        file.write(reinterpret_cast<const char*>(line.data()), std::streamsize(line.size()));
+    }
+    if (!file) std::cerr << "Failed to write " << filename << std::endl;
+    return bool(file);
+}
+
+// Averaged radiance, pixel(index, c) is the summed channel and count(index) the sample count
+template <typename Pixel, typename Count>
+bool writeRadiance(const std::string& filename, const int2 size, const HdrFormat format, const Pixel& pixel, const Count& count) {
+    const auto color = [&](const int x, const int y, const int c) {
+        const size_t index = size_t(y) * size.x + x;
+        const int n = count(index);
+        return n == 0 ? 0.0f : pixel(index, c) * (hdrScale / float(n));
+    };
+    if (format == HdrFormat::Pfm) return writePfm(filename, size, color);
+
+    // exr channels are alphabetical, so B G R
+    const int type = format == HdrFormat::ExrHalf ? 1 : 2;
+    return writeExr(filename, size, {{"B", type}, {"G", type}, {"R", type}},
+        [&](const int x, const int y, const int channel) { return color(x, y, 2 - channel); });
+}
+
+// Summed radiance plus an N channel with the sample count, so the buffer can be resumed or
+// re-averaged offline. Always float, half would lose precision on long accumulations.
+template <typename Pixel, typename Count>
+bool writeAccumulation(const std::string& filename, const int2 size, const Pixel& pixel, const Count& count) {
+    return writeExr(filename, size, {{"B", 2}, {"G", 2}, {"N", 0}, {"R", 2}},
+        [&](const int x, const int y, const int channel) {
+            const size_t index = size_t(y) * size.x + x;
+            if (channel == 2) return float(count(index));
+            return pixel(index, channel == 0 ? 2 : channel == 1 ? 1 : 0) * hdrScale;
+        });
+}
+
+} // namespace hdr
+
+// First hit AOVs as layers of one float EXR: albedo, depth, normal and the object and material
+// ids as uint channels. Depth is the average distance, FirstHit::skyDepth where only sky was seen.
+inline bool saveAovs(const std::string& filename, const int2 size, const GuideBuffers& guides) {
+    // exr channels are alphabetical
+    return hdr::writeExr(filename, size, {
+            {"albedo.B", 1}, {"albedo.G", 1}, {"albedo.R", 1}, {"depth.Z", 2}, {"materialId", 0},
+            {"normal.X", 1}, {"normal.Y", 1}, {"normal.Z", 1}, {"objectId", 0}},
+        [&](const int x, const int y, const int channel) {
+            const int index = y * size.x + x;
+            switch (channel) {
+                case 0: return guides.albedo(index).z;
+                case 1: return guides.albedo(index).y;
+                case 2: return guides.albedo(index).x;
+                case 3: return guides.depth(index);
+                case 4: return float(guides.material(index));
+                case 5: return guides.normal(index).x;
+                case 6: return guides.normal(index).y;
+                case 7: return guides.normal(index).z;
+                default: return float(guides.object(index));
+            }
+        });
+}
+
+inline bool saveRadiance(const std::string& filename, const Image& accum, const std::vector<int>& samples, const HdrFormat format) {
+    const float* src = accum.getData()->data();
+    const int* counts = samples.data();
+    return hdr::writeRadiance(filename, accum.getSize(), format,
+        [src](const size_t index, const int c) { return src[index*3+c]; },
+        [counts](const size_t index) { return counts[index]; });
+}
+inline bool saveRadiance(const std::string& filename, const AccumBuffer& accum, const HdrFormat format) {
+    const AccumPixel* src = accum.data();
+    return hdr::writeRadiance(filename, accum.getSize(), format,
+        [src](const size_t index, const int c) { return c == 0 ? src[index].r : c == 1 ? src[index].g : src[index].b; },
+        [src](const size_t index) { return int(src[index].samples); });
+}
+
+inline bool saveAccumulation(const std::string& filename, const Image& accum, const std::vector<int>& samples) {
+    const float* src = accum.getData()->data();
+    const int* counts = samples.data();
+    return hdr::writeAccumulation(filename, accum.getSize(),
+        [src](const size_t index, const int c) { return src[index*3+c]; },
+        [counts](const size_t index) { return counts[index]; });
+}
+inline bool saveAccumulation(const std::string& filename, const AccumBuffer& accum) {
+    const AccumPixel* src = accum.data();
+    return hdr::writeAccumulation(filename, accum.getSize(),
+        [src](const size_t index, const int c) { return c == 0 ? src[index].r : c == 1 ? src[index].g : src[index].b; },
+        [src](const size_t index) { return int(src[index].samples); });
+}
+
+#endif //HDRWRITER_H
@@ -13,6 +13,7 @@ class HitInfo {
     float t;
     float3 normal;
     Material *material;
+    uint32_t object = 0; // id of what was hit, 0 if the object doesn't have one
 
     public:
     HitInfo() {
@@ -39,6 +40,8 @@ class HitInfo {
     [[nodiscard]] float getT() const {return t;}
     [[nodiscard]] Material* getMaterial() const {return material;}
     [[nodiscard]] float3 getNormal() const {return normal;}
+    [[nodiscard]] uint32_t getObject() const {return object;}
+    void setObject(const uint32_t id) {object = id;}
 };
 
 #endif //COLLISION_H
@@ -17,7 +17,14 @@
 
 #include "int2.h"
 #include "float3.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
 #include <functional>
+#include <type_traits>
+#include <utility>
+#include "Parallel.h"
+#include "MappedFile.h"
 
 inline float linearizeF(float x) {
     x/=255;
@@ -31,6 +38,68 @@ inline float acesF(const float& x) {
     return a / b;
 }
 
+enum class TransferMode { Exact, Fast };
+
+// Branch free log2/exp2 approximations so the fast curves vectorize.
+// Max error: log2 1.5e-5 absolute, exp2 1.1e-7 relative.
+inline float fastLog2(const float x) {
+    uint32_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    const float exponent = float(int((bits >> 23) & 0xFF) - 127);
+    bits = (bits & 0x007FFFFFu) | 0x3F800000u;
+    float m;
+    std::memcpy(&m, &bits, sizeof(m));
+    const float t = m - 1;
+    const float p = ((((0.0439291f * t - 0.189834429f) * t + 0.411564149f) * t - 0.707254899f) * t + 1.44159239f) * t + 1.43725e-05f;
+    return exponent + p;
+}
+// x must be above -126
+inline float fastExp2(const float x) {
+    int i = int(x);
+    i -= int(float(i) > x); // floor without a branch
+    const float t = x - float(i);
+    const float p = ((((0.00189510797f * t + 0.00894621981f) * t + 0.0558632705f) * t + 0.240140778f) * t + 0.693154618f) * t + 0.999999896f;
+    const uint32_t bits = uint32_t(i + 127) << 23;
+    float scale;
+    std::memcpy(&scale, &bits, sizeof(scale));
+    return p * scale;
+}
+// linearizeF within 1.2e-3 (of 255) everywhere, tests/transfer_error checks it
+inline float linearizeFast(float x) {
+    x *= 1.0f / 255;
+    // clamp to [0, 1] on the bit pattern, float min/max here stops gcc vectorizing the loop
+    int32_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    bits &= ~(bits >> 31);
+    bits = std::min(bits, 0x3F800000);
+    std::memcpy(&x, &bits, sizeof(x));
+    return fastExp2(fastLog2(x) * float(1 / 2.2)) * 255;
+}
+// acesF with the divide replaced by a Newton refined reciprocal, relative error below 2.5e-7
+inline float acesFast(const float x) {
+    const float a = x * (x + 0.0245786f) - 0.000090537f;
+    const float b = x * 0.983729f + 0.4329510f;
+    uint32_t bits;
+    std::memcpy(&bits, &b, sizeof(bits));
+    bits = 0x7EF311C7u - bits;
+    float r;
+    std::memcpy(&r, &bits, sizeof(r));
+    r *= 2 - b * r;
+    r *= 2 - b * r;
+    r *= 2 - b * r;
+    return a * r;
+}
+template <TransferMode mode>
+float linearizeT(const float x) {
+    if constexpr (mode == TransferMode::Fast) return linearizeFast(x);
+    else return linearizeF(x);
+}
+template <TransferMode mode>
+float acesT(const float x) {
+    if constexpr (mode == TransferMode::Fast) return acesFast(x);
+    else return acesF(x);
+}
+
 class Image {
     int2 size;
     std::vector<float>* data;
@@ -53,6 +122,15 @@ class Image {
         size.y = height;
         this->data = data;
     }
+    Image(Image&& image) noexcept : size(image.size), data(image.data) {
+        image.size = {0, 0};
+        image.data = nullptr;
+    }
+    Image& operator=(Image image) noexcept {
+        std::swap(size, image.size);
+        std::swap(data, image.data);
+        return *this;
+    }
     Image(const Image& image) {
         size.x = image.size.x;
         size.y = image.size.y;
@@ -61,18 +139,47 @@ class Image {
             data->at(i) = image.data->at(i);
         }
     }
+    // Decodes from a read only mapping of the file. Gray images are expanded to rgb and alpha
+    // is dropped. An image that can't be loaded is left empty.
     explicit Image(const std::string& filename) {
+        size.x = size.y = 0;
+        data = nullptr;
+        MappedFile file;
+        if (file.openRead(filename) < 0) return;
+
         int width, height, channels;
-        const unsigned char* data = stbi_load(filename.c_str(), &width, &height, &channels, 0);
+        unsigned char* pixels = stbi_load_from_memory(static_cast<const stbi_uc*>(file.data()), int(file.size()), &width, &height, &channels, 0);
+        if (pixels == nullptr) {
+            std::cerr << "Failed to load " << filename << ": " << stbi_failure_reason() << std::endl;
+            return;
+        }
 
-        this->data = new std::vector<float>(width * height * 3);
-        this->size.x = width;
-        this->size.y = height;
-        for (int i = 0; i < width * height; i++) {
-            this->data->at(i*3) = data[i*channels];
-            this->data->at(i*3+1) = data[i*channels+1];
-            this->data->at(i*3+2) = data[i*channels+2];
+        const size_t count = size_t(width) * height;
+        size = {width, height};
+        data = new std::vector<float>(count * 3);
+        float* out = data->data();
+        if (channels >= 3) {
+            for (size_t i = 0; i < count; i++) {
+                out[i*3] = pixels[i*channels];
+                out[i*3+1] = pixels[i*channels+1];
+                out[i*3+2] = pixels[i*channels+2];
+            }
+        } else {
+            for (size_t i = 0; i < count; i++) {
+                out[i*3] = out[i*3+1] = out[i*3+2] = pixels[i*channels];
+            }
         }
+        stbi_image_free(pixels);
+    }
+
+    // Loads each file on a worker thread, for frame sequences and texture sets.
+    // Files that fail come back as empty images.
+    static std::vector<Image> loadImages(const std::vector<std::string>& filenames, const int threads = 0) {
+        std::vector<Image> images(filenames.size());
+        parallelFor(int(filenames.size()), [&](const int begin, const int end) {
+            for (int i = begin; i < end; i++) images[i] = Image(filenames[i]);
+        }, threads);
+        return images;
     }
     ~Image(){
         if (data == nullptr) {
@@ -132,6 +239,7 @@ class Image {
     }
     void clear(const int2 size) {
         this->size = size;
+        delete this->data;
         this->data = new std::vector<float>(size.x * size.y * 3);
     }
     void resize(const int2 size) {
@@ -147,14 +255,17 @@ class Image {
         }
     }
     void makePng(const std::string& filename) const {
-        auto* newData = new unsigned char[size.x * size.y * 3];
+        const std::vector<unsigned char> newData = toBytes();
+        stbi_write_png(filename.c_str(), size.x, size.y, 3, newData.data(), size.x * 3);
+    }
+    [[nodiscard]] std::vector<unsigned char> toBytes() const {
+        std::vector<unsigned char> bytes(size.x * size.y * 3);
         for (int i = 0; i < size.x*size.y*3; i++) {
             float color = data->at(i);
             if (color > 255) color = 255;
-            newData[i] = int(color);
+            bytes[i] = int(color);
         }
-        stbi_write_png(filename.c_str(), size.x, size.y, 3, newData, size.x * 3);
-        delete[] newData;
+        return bytes;
     }
     void blur(const int r) const {
         const Image image = *this;
@@ -302,17 +413,128 @@ class Image {
             }
         }
     }
-    void apply(const std::function<float3(float3)>& func) const {
-        for (int y = 0; y < size.y; y++) {
-            for (int x = 0; x < size.x; x++) {
-                write(x,y, func(read(x,y)));
+    // 13-tap bloom downsample from Jimenez, "Next Generation Post Processing in Call of Duty: Advanced Warfare".
+    // Over the 6x6 source block it covers, the kernel is the sum of two separable ones: half a 4x4 box
+    // and half a [1 1 2 2 1 1]/8 tent, so it runs as one horizontal and one vertical pass.
+    void bloomDownsample() {
+        const Image image = *this;
+        const int2 src = image.size;
+        clear({(src.x + 1) / 2, (src.y + 1) / 2});
+
+        std::vector<int> cols(size.x * 6);
+        for (int x = 0; x < size.x; x++) {
+            for (int t = 0; t < 6; t++) {
+                cols[x*6+t] = std::min(std::max(2*x - 2 + t, 0), src.x - 1) * 3;
             }
         }
-    }
-    void apply(const std::function<float(float)>& func) const {
-        for (int i = 0; i < size.x*size.y*3; i++) {
-            data->at(i) = func(data->at(i));
+        const Image box(size.x, src.y);
+        const Image tent(size.x, src.y);
+        const float* in = image.data->data();
+        float* boxOut = box.data->data();
+        float* tentOut = tent.data->data();
+        parallelFor(src.y, [&](const int begin, const int end) {
+            for (int y = begin; y < end; y++) {
+                const float* row = in + size_t(y) * src.x * 3;
+                for (int x = 0; x < size.x; x++) {
+                    const int* c = &cols[x*6];
+                    for (int ch = 0; ch < 3; ch++) {
+                        const float inner = row[c[2]+ch] + row[c[3]+ch];
+                        const float outer = row[c[0]+ch] + row[c[1]+ch] + row[c[4]+ch] + row[c[5]+ch];
+                        boxOut[(size_t(y) * size.x + x) * 3 + ch] = (inner + row[c[1]+ch] + row[c[4]+ch]) * 0.25f;
+                        tentOut[(size_t(y) * size.x + x) * 3 + ch] = (inner * 2 + outer) * 0.125f;
+                    }
+                }
+            }
+        });
+
+        float* out = data->data();
+        const int width = size.x * 3;
+        parallelFor(size.y, [&](const int begin, const int end) {
+            for (int y = begin; y < end; y++) {
+                const float* b[6];
+                const float* t[6];
+                for (int i = 0; i < 6; i++) {
+                    const int sy = std::min(std::max(2*y - 2 + i, 0), src.y - 1);
+                    b[i] = boxOut + size_t(sy) * width;
+                    t[i] = tentOut + size_t(sy) * width;
+                }
+                float* row = out + size_t(y) * width;
+                for (int i = 0; i < width; i++) {
+                    const float boxSum = (b[1][i] + b[2][i] + b[3][i] + b[4][i]) * 0.25f;
+                    const float tentSum = ((t[2][i] + t[3][i]) * 2 + t[0][i] + t[1][i] + t[4][i] + t[5][i]) * 0.125f;
+                    row[i] = 0.5f * (boxSum + tentSum);
+                }
+            }
+        });
+    }
+    // 3x3 tent filtered bilinear upsample to an arbitrary (larger) size, pairs with bloomDownsample.
+    // The tent is applied at the low resolution first, which is equivalent since both filters are linear.
+    void bloomUpsample(const int2 target) {
+        const int2 src = size;
+        const int width = src.x * 3;
+        const Image horizontal(src.x, src.y);
+        const float* in = data->data();
+        float* h = horizontal.data->data();
+        for (int y = 0; y < src.y; y++) {
+            const float* row = in + size_t(y) * width;
+            float* rowOut = h + size_t(y) * width;
+            for (int x = 0; x < src.x; x++) {
+                const int l = std::max(x - 1, 0) * 3;
+                const int r = std::min(x + 1, src.x - 1) * 3;
+                for (int ch = 0; ch < 3; ch++) {
+                    rowOut[x*3+ch] = (row[l+ch] + row[x*3+ch] * 2 + row[r+ch]) * 0.25f;
+                }
+            }
+        }
+        const Image tent(src.x, src.y);
+        float* t = tent.data->data();
+        for (int y = 0; y < src.y; y++) {
+            const float* up = h + size_t(std::max(y - 1, 0)) * width;
+            const float* mid = h + size_t(y) * width;
+            const float* down = h + size_t(std::min(y + 1, src.y - 1)) * width;
+            float* rowOut = t + size_t(y) * width;
+            for (int i = 0; i < width; i++) {
+                rowOut[i] = (up[i] + mid[i] * 2 + down[i]) * 0.25f;
+            }
         }
+
+        clear(target);
+        std::vector<int> x0(target.x), x1(target.x);
+        std::vector<float> fx(target.x);
+        for (int x = 0; x < target.x; x++) {
+            const float sx = std::max((float(x) + 0.5f) * float(src.x) / float(target.x) - 0.5f, 0.0f);
+            x0[x] = std::min(int(sx), src.x - 1) * 3;
+            x1[x] = std::min(int(sx) + 1, src.x - 1) * 3;
+            fx[x] = sx - float(int(sx));
+        }
+        float* out = data->data();
+        parallelFor(target.y, [&](const int begin, const int end) {
+            for (int y = begin; y < end; y++) {
+                const float sy = std::max((float(y) + 0.5f) * float(src.y) / float(target.y) - 0.5f, 0.0f);
+                const float fy = sy - float(int(sy));
+                const float* top = t + size_t(std::min(int(sy), src.y - 1)) * width;
+                const float* bottom = t + size_t(std::min(int(sy) + 1, src.y - 1)) * width;
+                float* row = out + size_t(y) * target.x * 3;
+                for (int x = 0; x < target.x; x++) {
+                    for (int ch = 0; ch < 3; ch++) {
+                        const float a = top[x0[x]+ch] + (top[x1[x]+ch] - top[x0[x]+ch]) * fx[x];
+                        const float b = bottom[x0[x]+ch] + (bottom[x1[x]+ch] - bottom[x0[x]+ch]) * fx[x];
+                        row[x*3+ch] = a + (b - a) * fy;
+                    }
+                }
+            }
+        });
+    }
+    // func is either float(float), applied per channel, or float3(float3), applied per pixel
+    template <typename F>
+    void apply(F&& func) const {
+        applyPixels(func, 0, size.x * size.y);
+    }
+    template <typename F>
+    void parallelApply(F&& func) const {
+        parallelFor(size.y, [&](const int begin, const int end) {
+            applyPixels(func, begin * size.x, end * size.x);
+        });
     }
     void clamp(const float min, const float max) const {
         for (int i = 0; i < size.x*size.y*3; i++) {
@@ -335,12 +557,26 @@ class Image {
             data->at(i*3+2) *= inv;
         }
     }
-    void linearize() const {
+    void linearize(const TransferMode mode = TransferMode::Exact) const {
+        if (mode == TransferMode::Fast) {
+            float* values = data->data();
+            for (int i = 0; i < size.x * size.y * 3; i++) {
+                values[i] = linearizeFast(values[i]);
+            }
+            return;
+        }
         for (int i = 0; i < size.x * size.y * 3; i++) {
             data->at(i) = linearizeF(data->at(i));
         }
     }
-    void aces() const {
+    void aces(const TransferMode mode = TransferMode::Exact) const {
+        if (mode == TransferMode::Fast) {
+            float* values = data->data();
+            for (int i = 0; i < size.x * size.y * 3; i++) {
+                values[i] = acesFast(values[i]);
+            }
+            return;
+        }
         for (int i = 0; i < size.x * size.y * 3; i++) {
             data->at(i) = acesF(data->at(i));
         }
@@ -377,6 +613,24 @@ class Image {
     [[nodiscard]] std::vector<float>* getData() const {
         return data;
     }
+
+    private:
+    template <typename F>
+    void applyPixels(F& func, const int begin, const int end) const {
+        float* values = data->data();
+        if constexpr (std::is_invocable_r_v<float, F&, float>) {
+            for (int i = begin * 3; i < end * 3; i++) {
+                values[i] = func(values[i]);
+            }
+        } else {
+            for (int i = begin; i < end; i++) {
+                const float3 color = func(float3(values[i*3], values[i*3+1], values[i*3+2]));
+                values[i*3] = color.x;
+                values[i*3+1] = color.y;
+                values[i*3+2] = color.z;
+            }
+        }
+    }
 };
 
 #endif //IMAGE_H
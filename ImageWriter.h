@@ -0,0 +1,146 @@
+//
+// Created by Andreas Royset on 10/18/26.
+//
+
+#ifndef IMAGEWRITER_H
+#define IMAGEWRITER_H
+
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "lodepng.h"
+#include "Image.h"
+#include "ParallelPng.h"
+#include "int2.h"
+
+// Png: stb's default deflate, smallest files.
+// PngFast: lodepng, paeth filter and a short lz77 window without lazy matching.
+// PngStored: lodepng with uncompressed deflate blocks, bound by disk speed.
+// PngParallel: strips filtered and deflated on every core, slightly smaller than stb and faster per core.
+// Qoi: the Quite OK Image format (qoiformat.org), lossless and usually several times faster than deflate.
+enum class ImageFormat { Png, PngFast, PngStored, PngParallel, Qoi };
+
+inline std::string imageExtension(const ImageFormat format) {
+    return format == ImageFormat::Qoi ? ".qoi" : ".png";
+}
+
+inline void savePng(const std::string& filename, const std::vector<unsigned char>& pixels, const int2 size) {
+    stbi_write_png(filename.c_str(), size.x, size.y, 3, pixels.data(), size.x * 3);
+}
+inline void savePng(const std::string& filename, const std::vector<uint16_t>& pixels, const int2 size) {
+    // PNG stores 16 bit samples big endian
+    std::vector<unsigned char> bytes(pixels.size() * 2);
+    for (size_t i = 0; i < pixels.size(); i++) {
+        bytes[i*2] = (unsigned char)(pixels[i] >> 8);
+        bytes[i*2+1] = (unsigned char)(pixels[i] & 0xFF);
+    }
+    const unsigned error = lodepng::encode(filename, bytes, size.x, size.y, LCT_RGB, 16);
+    if (error) std::cerr << "PNG error " << error << ": " << lodepng_error_text(error) << std::endl;
+}
+
+inline void saveLodePng(const std::string& filename, const std::vector<unsigned char>& pixels, const int2 size, const bool stored) {
+    lodepng::State state;
+    state.info_raw.colortype = LCT_RGB;
+    state.info_png.color.colortype = LCT_RGB;
+    state.encoder.auto_convert = 0; // skips the palette scan over every pixel
+    if (stored) {
+        state.encoder.zlibsettings.btype = 0;
+        state.encoder.filter_strategy = LFS_ZERO;
+    } else {
+        state.encoder.zlibsettings.btype = 2;
+        state.encoder.zlibsettings.windowsize = 256;
+        state.encoder.zlibsettings.nicematch = 32;
+        state.encoder.zlibsettings.lazymatching = 0;
+        state.encoder.filter_strategy = LFS_FOUR;
+    }
+
+    std::vector<unsigned char> png;
+    unsigned error = lodepng::encode(png, pixels, unsigned(size.x), unsigned(size.y), state);
+    if (!error) error = lodepng::save_file(png, filename);
+    if (error) std::cerr << "PNG error " << error << ": " << lodepng_error_text(error) << std::endl;
+}
+
+inline std::vector<unsigned char> encodeQoi(const std::vector<unsigned char>& pixels, const int2 size) {
+    struct Rgb { unsigned char r, g, b; };
+    const size_t count = size_t(size.x) * size.y;
+
+    std::vector<unsigned char> out;
+    out.reserve(14 + count * 4 + 8);
+    const auto put32 = [&out](const uint32_t v) {
+        out.push_back(v >> 24);
+        out.push_back((v >> 16) & 0xFF);
+        out.push_back((v >> 8) & 0xFF);
+        out.push_back(v & 0xFF);
+    };
+    out.insert(out.end(), {'q', 'o', 'i', 'f'});
+    put32(uint32_t(size.x));
+    put32(uint32_t(size.y));
+    out.push_back(3); // channels
+    out.push_back(0); // sRGB
+
+    Rgb seen[64] = {};
+    bool seenValid[64] = {};
+    Rgb prev = {0, 0, 0};
+    int run = 0;
+    for (size_t i = 0; i < count; i++) {
+        const Rgb px = {pixels[i*3], pixels[i*3+1], pixels[i*3+2]};
+        if (px.r == prev.r and px.g == prev.g and px.b == prev.b) {
+            if (++run == 62 or i == count - 1) {
+                out.push_back(0xC0 | (run - 1));
+                run = 0;
+            }
+            continue;
+        }
+        if (run > 0) {
+            out.push_back(0xC0 | (run - 1));
+            run = 0;
+        }
+
+        // alpha is always 255
+        const int hash = (px.r * 3 + px.g * 5 + px.b * 7 + 255 * 11) % 64;
+        if (seenValid[hash] and seen[hash].r == px.r and seen[hash].g == px.g and seen[hash].b == px.b) {
+            out.push_back(hash);
+        } else {
+            seen[hash] = px;
+            seenValid[hash] = true;
+            const int dr = int8_t(px.r - prev.r);
+            const int dg = int8_t(px.g - prev.g);
+            const int db = int8_t(px.b - prev.b);
+            const int drg = dr - dg;
+            const int dbg = db - dg;
+            if (dr >= -2 and dr <= 1 and dg >= -2 and dg <= 1 and db >= -2 and db <= 1) {
+                out.push_back(0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2));
+            } else if (dg >= -32 and dg <= 31 and drg >= -8 and drg <= 7 and dbg >= -8 and dbg <= 7) {
+                out.push_back(0x80 | (dg + 32));
+                out.push_back((drg + 8) << 4 | (dbg + 8));
+            } else {
+                out.insert(out.end(), {0xFE, px.r, px.g, px.b});
+            }
+        }
+        prev = px;
+    }
+    out.insert(out.end(), {0, 0, 0, 0, 0, 0, 0, 1});
+    return out;
+}
+
+inline void saveQoi(const std::string& filename, const std::vector<unsigned char>& pixels, const int2 size) {
+    const std::vector<unsigned char> qoi = encodeQoi(pixels, size);
+    std::ofstream file(filename, std::ios::binary);
+    file.write(reinterpret_cast<const char*>(qoi.data()), std::streamsize(qoi.size()));
+    if (!file) std::cerr << "Failed to write " << filename << std::endl;
+}
+
+// filename should end in imageExtension(format)
+inline void saveImage(const std::string& filename, const std::vector<unsigned char>& pixels, const int2 size, const ImageFormat format) {
+    switch (format) {
+        case ImageFormat::Png: savePng(filename, pixels, size); break;
+        case ImageFormat::PngFast: saveLodePng(filename, pixels, size, false); break;
+        case ImageFormat::PngStored: saveLodePng(filename, pixels, size, true); break;
+        case ImageFormat::PngParallel: savePngParallel(filename, pixels, size); break;
+        case ImageFormat::Qoi: saveQoi(filename, pixels, size); break;
+    }
+}
+
+#endif //IMAGEWRITER_H
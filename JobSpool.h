@@ -0,0 +1,162 @@
+//
+// Created by Andreas Royset on 10/18/26.
+//
+
+#ifndef JOBSPOOL_H
+#define JOBSPOOL_H
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "float3.h"
+
+// One still frame to render. A job file has one key=value per line, # starts a comment.
+//
+//   scene=scenes/default.scene      text or compiled scene, required
+//   output=renders/front.png        .png, .qoi, .exr or .pfm, required
+//   samples=200                     iterations, the scene's own count if left out
+//   frame=30                        frame of an animated camera, 1 if left out
+//   position=400,-200,-800          overrides the camera, needs target as well
+//   target=0,0,0
+struct RenderJob {
+    std::string name; // file name without .job
+    std::string scene;
+    std::string output;
+    int samples = 0;
+    int frame = 1;
+    bool hasCamera = false;
+    float3 position, target;
+};
+
+namespace job_spool {
+
+inline bool parseVector(const std::string& value, float3& out) {
+    float x, y, z;
+    char comma1, comma2;
+    std::istringstream stream(value);
+    if (!(stream >> x >> comma1 >> y >> comma2 >> z) or comma1 != ',' or comma2 != ',') return false;
+    out = {x, y, z};
+    return true;
+}
+
+// Errors go to std::cerr with the job's file name and line
+inline bool parseJob(const std::string& path, RenderJob& job) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "Failed to open job " << path << std::endl;
+        return false;
+    }
+    bool hasPosition = false, hasTarget = false;
+    std::string line;
+    for (int number = 1; std::getline(file, line); number++) {
+        line = line.substr(0, line.find('#'));
+        line.erase(0, line.find_first_not_of(" \t\r"));
+        line.erase(line.find_last_not_of(" \t\r") + 1);
+        if (line.empty()) continue;
+
+        const size_t equals = line.find('=');
+        if (equals == std::string::npos or equals + 1 == line.size()) {
+            std::cerr << path << ":" << number << ": expected key=value" << std::endl;
+            return false;
+        }
+        const std::string key = line.substr(0, equals);
+        const std::string value = line.substr(equals + 1);
+        bool ok = true;
+        if (key == "scene") job.scene = value;
+        else if (key == "output") job.output = value;
+        else if (key == "samples") ok = (std::istringstream(value) >> job.samples) and job.samples > 0;
+        else if (key == "frame") ok = (std::istringstream(value) >> job.frame) and job.frame > 0;
+        else if (key == "position") ok = hasPosition = parseVector(value, job.position);
+        else if (key == "target") ok = hasTarget = parseVector(value, job.target);
+        else {
+            std::cerr << path << ":" << number << ": unknown key '" << key << "'" << std::endl;
+            return false;
+        }
+        if (!ok) {
+            std::cerr << path << ":" << number << ": bad value for '" << key << "'" << std::endl;
+            return false;
+        }
+    }
+    if (job.scene.empty() or job.output.empty()) {
+        std::cerr << path << ": a job needs a scene and an output" << std::endl;
+        return false;
+    }
+    if (hasPosition != hasTarget) {
+        std::cerr << path << ": position and target go together" << std::endl;
+        return false;
+    }
+    job.hasCamera = hasPosition;
+    return true;
+}
+
+} // namespace job_spool
+
+// A directory other programs drop .job files into. A job is claimed by renaming it to
+// .running, so a crashed daemon's job is picked up again on the next start, and ends as
+// .done or .failed. While it runs, .progress holds one line about how far it got.
+// Creating a file named stop in the directory shuts the daemon down after the current job.
+class JobSpool {
+    std::filesystem::path directory;
+
+    [[nodiscard]] std::filesystem::path file(const std::string& name, const std::string& extension) const {
+        return directory / (name + extension);
+    }
+
+    public:
+    explicit JobSpool(std::filesystem::path directory) : directory(std::move(directory)) {
+        std::error_code error;
+        std::filesystem::create_directories(this->directory, error);
+        for (const auto& entry : std::filesystem::directory_iterator(this->directory, error)) {
+            if (entry.path().extension() == ".running") {
+                std::filesystem::rename(entry.path(), file(entry.path().stem().string(), ".job"), error);
+            }
+        }
+    }
+
+    [[nodiscard]] bool isOpen() const {
+        return std::filesystem::is_directory(directory);
+    }
+
+    // Claims the first pending job by name, false if there is none. Jobs that don't parse
+    // are failed straight away.
+    bool next(RenderJob& job) {
+        std::vector<std::string> pending;
+        std::error_code error;
+        for (const auto& entry : std::filesystem::directory_iterator(directory, error)) {
+            if (entry.path().extension() == ".job") pending.push_back(entry.path().stem().string());
+        }
+        std::sort(pending.begin(), pending.end());
+        for (const std::string& name : pending) {
+            // a job another daemon claimed first is simply gone
+            std::filesystem::rename(file(name, ".job"), file(name, ".running"), error);
+            if (error) continue;
+            job = RenderJob();
+            job.name = name;
+            if (job_spool::parseJob(file(name, ".running").string(), job)) return true;
+            finish(job, false);
+        }
+        return false;
+    }
+
+    void progress(const RenderJob& job, const std::string& line) const {
+        std::ofstream(file(job.name, ".progress"), std::ios::trunc) << line << std::endl;
+    }
+
+    void finish(const RenderJob& job, const bool ok) const {
+        std::error_code error;
+        std::filesystem::remove(file(job.name, ".progress"), error);
+        std::filesystem::rename(file(job.name, ".running"), file(job.name, ok ? ".done" : ".failed"), error);
+    }
+
+    // Removes the stop file if there is one
+    bool stopRequested() const {
+        std::error_code error;
+        return std::filesystem::remove(directory / "stop", error);
+    }
+};
+
+#endif //JOBSPOOL_H
@@ -0,0 +1,51 @@
+//
+// Created by Andreas Royset on 10/18/26.
+//
+
+#ifndef LIGHT_H
+#define LIGHT_H
+
+#include <cmath>
+#include <vector>
+#include "Material.h"
+#include "Sampling.h"
+#include "float3.h"
+
+// An emissive sphere, sampled by the cone it covers as seen from the shading point
+struct SphereLight {
+    float3 center;
+    float radius;
+    const Material* material;
+
+    // Cosine of the cone's half angle, false from inside the light
+    [[nodiscard]] bool cone(const float3& point, float& cosMax) const {
+        const float distance2 = (center - point).mag2();
+        if (distance2 <= radius * radius) return false;
+        cosMax = std::sqrt(std::max(0.0f, 1.0f - radius * radius / distance2));
+        return true;
+    }
+
+    // Direction from point towards the light and the solid angle it was drawn from
+    bool sample(const float3& point, const float u1, const float u2, float3& dir, float& solidAngle) const {
+        float cosMax;
+        if (!cone(point, cosMax)) return false;
+        const Onb onb((center - point).normalize());
+        dir = sampleCone(onb, cosMax, u1, u2).normalize();
+        solidAngle = coneSolidAngle(cosMax);
+        return solidAngle > 0;
+    }
+
+    // True if point lies on this light, for telling which light a path ran into
+    [[nodiscard]] bool contains(const Material* hitMaterial, const float3& point) const {
+        return hitMaterial == material and std::abs((point - center).mag() - radius) < 1e-3f * radius + 1e-3f;
+    }
+};
+
+inline int findLight(const std::vector<SphereLight>& lights, const Material* material, const float3& point) {
+    for (size_t i = 0; i < lights.size(); i++) {
+        if (lights[i].contains(material, point)) return int(i);
+    }
+    return -1;
+}
+
+#endif //LIGHT_H
@@ -0,0 +1,163 @@
+//
+// Created by Andreas Royset on 10/18/26.
+//
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <utility>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// A read/write file mapping. open() grows or truncates the file to bytes, the contents
+// that were already there are kept.
+class MappedFile {
+    void* mapping = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE view = nullptr;
+#else
+    int file = -1;
+#endif
+
+    public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept {
+        *this = std::move(other);
+    }
+    MappedFile& operator=(MappedFile&& other) noexcept {
+        if (this != &other) {
+            close();
+            std::swap(mapping, other.mapping);
+            std::swap(length, other.length);
+            std::swap(file, other.file);
+#ifdef _WIN32
+            std::swap(view, other.view);
+#endif
+        }
+        return *this;
+    }
+    ~MappedFile() {
+        close();
+    }
+
+    // Returns how many bytes the file had before it was resized, or -1 on failure
+    long long open(const std::string& path, const size_t bytes) {
+        close();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return fail(path);
+        LARGE_INTEGER previous;
+        GetFileSizeEx(file, &previous);
+        view = CreateFileMappingA(file, nullptr, PAGE_READWRITE, DWORD(uint64_t(bytes) >> 32), DWORD(bytes), nullptr);
+        if (view == nullptr) return fail(path);
+        mapping = MapViewOfFile(view, FILE_MAP_ALL_ACCESS, 0, 0, bytes);
+        if (mapping == nullptr) return fail(path);
+        length = bytes;
+        return previous.QuadPart;
+#else
+        file = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (file < 0) return fail(path);
+        struct stat info{};
+        if (fstat(file, &info) != 0 or ftruncate(file, off_t(bytes)) != 0) return fail(path);
+        mapping = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+        if (mapping == MAP_FAILED) {
+            mapping = nullptr;
+            return fail(path);
+        }
+        length = bytes;
+        return info.st_size;
+#endif
+    }
+
+    // Maps an existing file read only, returns its size or -1 on failure. copyOnWrite allows
+    // writing to the mapping without the changes reaching the file.
+    long long openRead(const std::string& path, const bool copyOnWrite = false) {
+        close();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return fail(path);
+        LARGE_INTEGER bytes;
+        if (!GetFileSizeEx(file, &bytes) or bytes.QuadPart == 0) return fail(path);
+        view = CreateFileMappingA(file, nullptr, copyOnWrite ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, nullptr);
+        if (view == nullptr) return fail(path);
+        mapping = MapViewOfFile(view, copyOnWrite ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+        if (mapping == nullptr) return fail(path);
+        length = size_t(bytes.QuadPart);
+#else
+        file = ::open(path.c_str(), O_RDONLY);
+        if (file < 0) return fail(path);
+        struct stat info{};
+        if (fstat(file, &info) != 0 or info.st_size == 0) return fail(path);
+        mapping = mmap(nullptr, size_t(info.st_size), copyOnWrite ? PROT_READ | PROT_WRITE : PROT_READ, MAP_PRIVATE, file, 0);
+        if (mapping == MAP_FAILED) {
+            mapping = nullptr;
+            return fail(path);
+        }
+        length = size_t(info.st_size);
+#endif
+        return (long long)length;
+    }
+
+    // Pushes dirty pages to disk. Pages survive the process being killed either way,
+    // this is only needed to survive the machine going down.
+    void flush(const bool wait = false) const {
+        if (mapping == nullptr) return;
+#ifdef _WIN32
+        FlushViewOfFile(mapping, 0);
+        if (wait) FlushFileBuffers(file);
+#else
+        msync(mapping, length, wait ? MS_SYNC : MS_ASYNC);
+#endif
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (mapping != nullptr) UnmapViewOfFile(mapping);
+        if (view != nullptr) CloseHandle(view);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        view = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (mapping != nullptr) munmap(mapping, length);
+        if (file >= 0) ::close(file);
+        file = -1;
+#endif
+        mapping = nullptr;
+        length = 0;
+    }
+
+    [[nodiscard]] void* data() const {
+        return mapping;
+    }
+    [[nodiscard]] size_t size() const {
+        return length;
+    }
+    [[nodiscard]] bool isOpen() const {
+        return mapping != nullptr;
+    }
+
+    private:
+    long long fail(const std::string& path) {
+        std::cerr << "Failed to map " << path << std::endl;
+        close();
+        return -1;
+    }
+};
+
+#endif //MAPPEDFILE_H
@@ -6,6 +6,7 @@
 #define MATERIAL_H
 
 #include "float3.h"
+#include "Hash.h"
 
 class Material {
     public:
@@ -38,6 +39,18 @@ class Material {
         this->emission_color = emission_color;
     }
 
+    void hash(Hasher& hasher) const {
+        hasher.add(color).add(smoothness).add(specular_probability).add(specular_color);
+        hasher.add(transparency).add(index_of_refraction).add(emission_color);
+    }
+
+    // The same for materials that look the same, wherever they are stored
+    [[nodiscard]] uint32_t id() const {
+        Hasher hasher;
+        hash(hasher);
+        return hashId(hasher.get());
+    }
+
     Material* avg(const Material* other) const {
         auto result = new Material();
         result->color = (color+other->color)/2;
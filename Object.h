@@ -5,12 +5,36 @@
 #ifndef OBJECT_H
 #define OBJECT_H
 
+#include <cstdint>
+#include <vector>
 #include "HitInfo.h"
+#include "Hash.h"
+#include "Light.h"
+
+enum class PrimitiveType : uint32_t { Sphere, Box };
+
+// Flat copy of an object for the BVH and the compiled scene cache
+struct Primitive {
+    PrimitiveType type;
+    uint32_t material; // index into the material array next to the primitives
+    float3 a; // sphere center or box min corner
+    float3 b; // sphere radius in x or box max corner
+};
+static_assert(sizeof(Primitive) == 32, "Primitive is stored in compiled scenes");
 
 class Object {
 public:
     virtual ~Object() = default;
     [[nodiscard]] virtual HitInfo* checkCollision(const float3& pos, const float3& dir, const float3& inv_dir) const = 0;
+    // Feeds everything that affects the image into hasher
+    virtual void hash(Hasher& hasher) const = 0;
+    // Fills in everything but out.material, objects that return false are tested on their own
+    virtual bool flatten(Primitive& /*out*/, Material*& /*material*/) const {
+        return false;
+    }
+    // Adds the parts that emit light and can be sampled directly
+    virtual void lights(std::vector<SphereLight>& /*out*/) const {
+    }
 };
 
 #endif //OBJECT_H
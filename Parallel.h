@@ -0,0 +1,31 @@
+//
+// Created by Andreas Royset on 10/18/26.
+//
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+// Splits [0, count) into one contiguous chunk per thread and runs func(begin, end) on each.
+template <typename F>
+void parallelFor(const int count, F&& func, int threads = 0) {
+    if (threads <= 0) threads = int(std::thread::hardware_concurrency());
+    threads = std::max(1, std::min(threads, count));
+    if (threads == 1) {
+        func(0, count);
+        return;
+    }
+
+    const int chunk = (count + threads - 1) / threads;
+    std::vector<std::thread> workers;
+    for (int begin = 0; begin < count; begin += chunk) {
+        const int end = std::min(count, begin + chunk);
+        workers.emplace_back([&func, begin, end] { func(begin, end); });
+    }
+    for (auto& worker : workers) worker.join();
+}
+
+#endif //PARALLEL_H
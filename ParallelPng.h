@@ -0,0 +1,370 @@
+//
+// Created by Andreas Royset on 10/18/26.
+//
+
+#ifndef PARALLELPNG_H
+#define PARALLELPNG_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Parallel.h"
+#include "int2.h"
+
+// PNG writer that filters and deflates horizontal strips of the image on separate threads.
+// Every strip is an independent run of fixed huffman deflate blocks ending in a sync flush
+// (an empty stored block), so the strips concatenate into one valid zlib stream, each in its own IDAT chunk.
+namespace parallel_png {
+
+inline uint32_t crc32(const unsigned char* data, const size_t length, uint32_t crc = 0) {
+    static const std::vector<uint32_t> table = [] {
+        std::vector<uint32_t> t(256);
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++) c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[n] = c;
+        }
+        return t;
+    }();
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+inline uint32_t adler32(const unsigned char* data, size_t length) {
+    constexpr uint32_t base = 65521;
+    uint32_t a = 1, b = 0;
+    while (length > 0) {
+        const size_t block = std::min(length, size_t(5552)); // largest run that can't overflow b
+        for (size_t i = 0; i < block; i++) {
+            a += data[i];
+            b += a;
+        }
+        a %= base;
+        b %= base;
+        data += block;
+        length -= block;
+    }
+    return b << 16 | a;
+}
+
+// adler32 of A followed by B, from adler32(A), adler32(B) and the length of B (zlib's adler32_combine)
+inline uint32_t adler32Combine(const uint32_t first, const uint32_t second, const size_t secondLength) {
+    constexpr uint32_t base = 65521;
+    const uint32_t rem = uint32_t(secondLength % base);
+    uint32_t sum1 = first & 0xFFFF;
+    uint32_t sum2 = uint32_t((uint64_t(rem) * sum1) % base);
+    sum1 += (second & 0xFFFF) + base - 1;
+    sum2 += (first >> 16) + (second >> 16) + base - rem;
+    if (sum1 >= base) sum1 -= base;
+    if (sum1 >= base) sum1 -= base;
+    if (sum2 >= base << 1) sum2 -= base << 1;
+    if (sum2 >= base) sum2 -= base;
+    return sum2 << 16 | sum1;
+}
+
+class BitWriter {
+    uint64_t buffer = 0;
+    int count = 0;
+
+    public:
+    std::vector<unsigned char> bytes;
+
+    // LSB first, huffman codes have to be bit reversed by the caller
+    void put(const uint32_t value, const int bits) {
+        buffer |= uint64_t(value) << count;
+        count += bits;
+        while (count >= 8) {
+            bytes.push_back((unsigned char)(buffer & 0xFF));
+            buffer >>= 8;
+            count -= 8;
+        }
+    }
+    void align() {
+        if (count > 0) put(0, 8 - count);
+    }
+};
+
+struct FixedCodes {
+    uint16_t literal[288]; // bit reversed, ready for BitWriter::put
+    uint8_t literalBits[288];
+    uint16_t distance[30];
+    uint8_t lengthCode[259]; // match length -> length symbol - 257
+    uint8_t distanceCode[512]; // see distanceSymbol
+
+    FixedCodes() : literal(), literalBits(), distance(), lengthCode(), distanceCode() {
+        const auto reverse = [](const uint32_t code, const int bits) {
+            uint32_t reversed = 0;
+            for (int i = 0; i < bits; i++) reversed |= ((code >> i) & 1) << (bits - 1 - i);
+            return uint16_t(reversed);
+        };
+        for (int symbol = 0; symbol < 288; symbol++) {
+            uint32_t code;
+            int bits;
+            if (symbol < 144) { code = 0x30 + symbol; bits = 8; }
+            else if (symbol < 256) { code = 0x190 + symbol - 144; bits = 9; }
+            else if (symbol < 280) { code = symbol - 256; bits = 7; }
+            else { code = 0xC0 + symbol - 280; bits = 8; }
+            literal[symbol] = reverse(code, bits);
+            literalBits[symbol] = uint8_t(bits);
+        }
+        for (int d = 0; d < 30; d++) distance[d] = reverse(d, 5);
+        for (int length = 3; length <= 258; length++) {
+            int l = 28;
+            while (lengthBase[l] > length) l--;
+            lengthCode[length] = uint8_t(l);
+        }
+        for (int d = 1; d <= 256; d++) distanceCode[d - 1] = uint8_t(slowDistanceCode(d));
+        for (int d = 257; d <= 32768; d += 128) distanceCode[256 + ((d - 1) >> 7)] = uint8_t(slowDistanceCode(d));
+    }
+
+    [[nodiscard]] int distanceSymbol(const int d) const {
+        return d <= 256 ? distanceCode[d - 1] : distanceCode[256 + ((d - 1) >> 7)];
+    }
+
+    static constexpr int lengthBase[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    static constexpr int lengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    static constexpr int distanceBase[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+    static constexpr int distanceExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+    private:
+    static int slowDistanceCode(const int distance) {
+        int d = 29;
+        while (distanceBase[d] > distance) d--;
+        return d;
+    }
+};
+
+inline const FixedCodes& fixedCodes() {
+    static const FixedCodes codes;
+    return codes;
+}
+
+inline void putLiteral(BitWriter& out, const FixedCodes& codes, const int symbol) {
+    out.put(codes.literal[symbol], codes.literalBits[symbol]);
+}
+
+inline void putMatch(BitWriter& out, const FixedCodes& codes, const int length, const int distance) {
+    const int l = codes.lengthCode[length];
+    putLiteral(out, codes, 257 + l);
+    out.put(length - FixedCodes::lengthBase[l], FixedCodes::lengthExtra[l]);
+
+    const int d = codes.distanceSymbol(distance);
+    out.put(codes.distance[d], 5);
+    out.put(distance - FixedCodes::distanceBase[d], FixedCodes::distanceExtra[d]);
+}
+
+// Greedy LZ77 with hash chains and fixed huffman codes, references stay inside data.
+// Ends in a sync flush so the next strip can start on a byte boundary.
+inline std::vector<unsigned char> deflateStrip(const unsigned char* data, const size_t length) {
+    constexpr int window = 32768;
+    constexpr int hashBits = 15;
+    constexpr int maxChain = 16;
+    constexpr int niceLength = 128;
+    constexpr int maxLength = 258;
+    constexpr size_t blockSize = 1 << 16; // symbols per block header, keeps blocks a sane size
+
+    const FixedCodes& codes = fixedCodes();
+    BitWriter out;
+    out.bytes.reserve(length / 2 + 64);
+    std::vector<int> head(1 << hashBits, -1);
+    std::vector<int> prev(window, -1);
+    const auto hash = [data](const size_t i) {
+        return ((uint32_t(data[i]) << 16 | uint32_t(data[i+1]) << 8 | data[i+2]) * 2654435761u) >> (32 - hashBits);
+    };
+    const auto insert = [&](const size_t i) {
+        const uint32_t h = hash(i);
+        prev[i % window] = head[h];
+        head[h] = int(i);
+    };
+
+    size_t i = 0;
+    size_t blockStart = 0;
+    out.put(0, 1); // BFINAL
+    out.put(1, 2); // fixed huffman
+    while (i < length) {
+        if (i - blockStart >= blockSize) {
+            putLiteral(out, codes, 256);
+            out.put(0, 1);
+            out.put(1, 2);
+            blockStart = i;
+        }
+
+        int bestLength = 0;
+        int bestDistance = 0;
+        if (i + 3 <= length) {
+            const int limit = int(std::min(size_t(maxLength), length - i));
+            int candidate = head[hash(i)];
+            for (int chain = 0; chain < maxChain and candidate >= 0 and int(i) - candidate <= window - 1; chain++) {
+                if (bestLength < limit and data[candidate + bestLength] == data[i + bestLength]) {
+                    int len = 0;
+                    while (len < limit and data[candidate + len] == data[i + len]) len++;
+                    if (len > bestLength) {
+                        bestLength = len;
+                        bestDistance = int(i) - candidate;
+                        if (len >= niceLength) break;
+                    }
+                }
+                const int next = prev[candidate % window];
+                if (next >= candidate) break;
+                candidate = next;
+            }
+        }
+
+        if (bestLength >= 3) {
+            putMatch(out, codes, bestLength, bestDistance);
+            const size_t end = i + bestLength;
+            for (; i < end; i++) {
+                if (i + 3 <= length) insert(i);
+            }
+        } else {
+            putLiteral(out, codes, data[i]);
+            if (i + 3 <= length) insert(i);
+            i++;
+        }
+    }
+    putLiteral(out, codes, 256);
+
+    // sync flush: empty non-final stored block
+    out.put(0, 3);
+    out.align();
+    out.bytes.insert(out.bytes.end(), {0x00, 0x00, 0xFF, 0xFF});
+    return out.bytes;
+}
+
+inline unsigned char paeth(const int a, const int b, const int c) {
+    const int p = a + b - c;
+    const int pa = std::abs(p - a);
+    const int pb = std::abs(p - b);
+    const int pc = std::abs(p - c);
+    if (pa <= pb and pa <= pc) return (unsigned char)a;
+    if (pb <= pc) return (unsigned char)b;
+    return (unsigned char)c;
+}
+
+// Writes the filter byte and filtered row into out, picking the filter with the smallest sum of
+// absolute signed residuals (the heuristic libpng and stb use).
+inline void filterRow(const unsigned char* row, const unsigned char* above, const int rowBytes, const int bpp, unsigned char* out) {
+    static thread_local std::vector<unsigned char> zeros;
+    static thread_local std::vector<unsigned char> candidates;
+    if (above == nullptr) {
+        zeros.assign(rowBytes, 0);
+        above = zeros.data();
+    }
+    candidates.resize(size_t(rowBytes) * 5);
+    unsigned char* f[5];
+    for (int filter = 0; filter < 5; filter++) f[filter] = candidates.data() + size_t(filter) * rowBytes;
+
+    for (int i = 0; i < bpp; i++) {
+        f[0][i] = row[i];
+        f[1][i] = row[i];
+        f[2][i] = (unsigned char)(row[i] - above[i]);
+        f[3][i] = (unsigned char)(row[i] - (above[i] >> 1));
+        f[4][i] = (unsigned char)(row[i] - above[i]); // paeth with a = c = 0 predicts b
+    }
+    for (int i = bpp; i < rowBytes; i++) {
+        f[0][i] = row[i];
+        f[1][i] = (unsigned char)(row[i] - row[i - bpp]);
+        f[2][i] = (unsigned char)(row[i] - above[i]);
+        f[3][i] = (unsigned char)(row[i] - ((row[i - bpp] + above[i]) >> 1));
+        f[4][i] = (unsigned char)(row[i] - paeth(row[i - bpp], above[i], above[i - bpp]));
+    }
+
+    int bestFilter = 0;
+    long bestCost = -1;
+    for (int filter = 0; filter < 5; filter++) {
+        long cost = 0;
+        for (int i = 0; i < rowBytes; i++) cost += std::abs(int(int8_t(f[filter][i])));
+        if (bestCost < 0 or cost < bestCost) {
+            bestCost = cost;
+            bestFilter = filter;
+        }
+    }
+    out[0] = (unsigned char)bestFilter;
+    std::copy_n(f[bestFilter], rowBytes, out + 1);
+}
+
+inline void appendChunk(std::vector<unsigned char>& png, const char* type, const unsigned char* data, const size_t length) {
+    const auto put32 = [&png](const uint32_t v) {
+        png.push_back(v >> 24);
+        png.push_back((v >> 16) & 0xFF);
+        png.push_back((v >> 8) & 0xFF);
+        png.push_back(v & 0xFF);
+    };
+    put32(uint32_t(length));
+    const size_t start = png.size();
+    png.insert(png.end(), type, type + 4);
+    png.insert(png.end(), data, data + length);
+    put32(crc32(png.data() + start, length + 4));
+}
+
+} // namespace parallel_png
+
+// rgb is size.x * size.y * 3 bytes, top row first
+inline std::vector<unsigned char> encodePngParallel(const std::vector<unsigned char>& rgb, const int2 size, int threads = 0) {
+    using namespace parallel_png;
+    if (threads <= 0) threads = int(std::thread::hardware_concurrency());
+    const int rowBytes = size.x * 3;
+    const int rowsPerStrip = std::max(32, (size.y + threads * 2 - 1) / (threads * 2));
+    const int strips = (size.y + rowsPerStrip - 1) / rowsPerStrip;
+
+    std::vector<std::vector<unsigned char>> compressed(strips);
+    std::vector<uint32_t> adlers(strips);
+    std::vector<size_t> lengths(strips);
+    parallelFor(strips, [&](const int begin, const int end) {
+        std::vector<unsigned char> filtered;
+        for (int s = begin; s < end; s++) {
+            const int y0 = s * rowsPerStrip;
+            const int y1 = std::min(size.y, y0 + rowsPerStrip);
+            filtered.resize(size_t(y1 - y0) * (rowBytes + 1));
+            for (int y = y0; y < y1; y++) {
+                const unsigned char* row = rgb.data() + size_t(y) * rowBytes;
+                const unsigned char* above = y > 0 ? row - rowBytes : nullptr;
+                filterRow(row, above, rowBytes, 3, filtered.data() + size_t(y - y0) * (rowBytes + 1));
+            }
+            compressed[s] = deflateStrip(filtered.data(), filtered.size());
+            adlers[s] = adler32(filtered.data(), filtered.size());
+            lengths[s] = filtered.size();
+        }
+    }, threads);
+
+    uint32_t adler = adlers[0];
+    for (int s = 1; s < strips; s++) adler = adler32Combine(adler, adlers[s], lengths[s]);
+
+    std::vector<unsigned char> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    const unsigned char header[13] = {
+        (unsigned char)(size.x >> 24), (unsigned char)(size.x >> 16), (unsigned char)(size.x >> 8), (unsigned char)size.x,
+        (unsigned char)(size.y >> 24), (unsigned char)(size.y >> 16), (unsigned char)(size.y >> 8), (unsigned char)size.y,
+        8, 2, 0, 0, 0 // 8 bit rgb, deflate, adaptive filtering, no interlace
+    };
+    appendChunk(png, "IHDR", header, sizeof(header));
+
+    constexpr unsigned char zlibHeader[2] = {0x78, 0x01};
+    appendChunk(png, "IDAT", zlibHeader, sizeof(zlibHeader));
+    for (const std::vector<unsigned char>& strip : compressed) {
+        appendChunk(png, "IDAT", strip.data(), strip.size());
+    }
+    const unsigned char trailer[6] = { // empty final fixed huffman block, then the adler32
+        0x03, 0x00,
+        (unsigned char)(adler >> 24), (unsigned char)(adler >> 16), (unsigned char)(adler >> 8), (unsigned char)adler
+    };
+    appendChunk(png, "IDAT", trailer, sizeof(trailer));
+    appendChunk(png, "IEND", nullptr, 0);
+    return png;
+}
+
+inline void savePngParallel(const std::string& filename, const std::vector<unsigned char>& rgb, const int2 size) {
+    const std::vector<unsigned char> png = encodePngParallel(rgb, size);
+    std::ofstream file(filename, std::ios::binary);
+    file.write(reinterpret_cast<const char*>(png.data()), std::streamsize(png.size()));
+    if (!file) std::cerr << "Failed to write " << filename << std::endl;
+}
+
+#endif //PARALLELPNG_H
@@ -0,0 +1,75 @@
+//
+// Created by Andreas Royset on 10/18/26.
+//
+
+#ifndef PATHSTATS_H
+#define PATHSTATS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+// How paths end and branch. From rouletteStart bounces on a path survives with its throughput,
+// summed over rgb and over survival, as probability, at most 1. bounceLim still ends it. The
+// camera ray itself is never cut. splits paths continue from the first hit of every camera
+// ray, fewer on surfaces that reflect little, where more of them would add little light.
+struct PathSettings {
+    int rouletteStart = 6;
+    float survival = 1;
+    int splits = 1;
+
+    [[nodiscard]] bool operator==(const PathSettings& other) const {
+        return rouletteStart == other.rouletteStart and survival == other.survival and splits == other.splits;
+    }
+    [[nodiscard]] bool operator!=(const PathSettings& other) const {
+        return !(*this == other);
+    }
+};
+
+enum class PathEnd { Escaped, Emitter, Roulette, BounceLimit, Count };
+
+// How many bounces traced paths took and what ended them, to weigh a scene's cost against its
+// noise when tuning the roulette
+struct PathStats {
+    std::vector<uint64_t> lengths; // paths by bounce count
+    uint64_t ends[int(PathEnd::Count)] = {};
+
+    void add(const int length, const PathEnd end) {
+        if (size_t(length) >= lengths.size()) lengths.resize(size_t(length) + 1, 0);
+        lengths[length]++;
+        ends[int(end)]++;
+    }
+    void merge(const PathStats& other) {
+        if (other.lengths.size() > lengths.size()) lengths.resize(other.lengths.size(), 0);
+        for (size_t i = 0; i < other.lengths.size(); i++) lengths[i] += other.lengths[i];
+        for (int i = 0; i < int(PathEnd::Count); i++) ends[i] += other.ends[i];
+    }
+
+    [[nodiscard]] uint64_t paths() const {
+        uint64_t count = 0;
+        for (const uint64_t length : lengths) count += length;
+        return count;
+    }
+    [[nodiscard]] double meanLength() const {
+        uint64_t bounces = 0;
+        for (size_t i = 0; i < lengths.size(); i++) bounces += lengths[i] * i;
+        return paths() > 0 ? double(bounces) / double(paths()) : 0;
+    }
+
+    // Two lines, the ends and the histogram of lengths, as shares of all paths
+    void report(std::ostream& out) const {
+        const double total = double(std::max<uint64_t>(paths(), 1));
+        const auto percent = [&](const uint64_t count) {
+            return int(100.0 * double(count) / total + 0.5);
+        };
+        static const char* names[int(PathEnd::Count)] = {"escaped", "emitter", "roulette", "bounce limit"};
+        out << "Paths  -  " << paths() << ", " << int(meanLength() * 100 + 0.5) / 100.0 << " bounces on average  -  ended by";
+        for (int i = 0; i < int(PathEnd::Count); i++) out << (i > 0 ? ", " : " ") << names[i] << " " << percent(ends[i]) << "%";
+        out << std::endl << "Bounces  -";
+        for (size_t i = 0; i < lengths.size(); i++) out << "  " << i << ": " << percent(lengths[i]) << "%";
+        out << std::endl;
+    }
+};
+
+#endif //PATHSTATS_H
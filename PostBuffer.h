@@ -0,0 +1,61 @@
+//
+// Created by Andreas Royset on 10/18/26.
+//
+
+#ifndef POSTBUFFER_H
+#define POSTBUFFER_H
+
+#include <cstdint>
+#include <vector>
+#include "half.h"
+#include "Image.h"
+#include "int2.h"
+
+enum class Precision { Float32, Float16 };
+
+// Read-only copy of an Image kept between post passes (bloom mip levels), optionally stored as fp16.
+class PostBuffer {
+    int2 size;
+    Precision precision;
+    std::vector<float> full;
+    std::vector<uint16_t> half;
+
+    public:
+    PostBuffer(const Image& image, const Precision precision) {
+        size = image.getSize();
+        this->precision = precision;
+        const std::vector<float>& values = *image.getData();
+        if (precision == Precision::Float16) {
+            half.resize(values.size());
+            for (size_t i = 0; i < values.size(); i++) {
+                half[i] = floatToHalf(values[i]);
+            }
+        } else {
+            full = values;
+        }
+    }
+
+    // target += this * weight, target must be the same size
+    void addTo(const Image& target, const float weight) const {
+        float* out = target.getData()->data();
+        const size_t count = size_t(size.x) * size.y * 3;
+        if (precision == Precision::Float16) {
+            for (size_t i = 0; i < count; i++) {
+                out[i] += halfToFloat(half[i]) * weight;
+            }
+        } else {
+            for (size_t i = 0; i < count; i++) {
+                out[i] += full[i] * weight;
+            }
+        }
+    }
+
+    [[nodiscard]] int2 getSize() const {
+        return size;
+    }
+    [[nodiscard]] size_t bytes() const {
+        return full.size() * sizeof(float) + half.size() * sizeof(uint16_t);
+    }
+};
+
+#endif //POSTBUFFER_H
@@ -12,6 +12,12 @@
 #include "Material.h"
 #include "Floor.h"
 #include "Sky.h"
+#include "Light.h"
+#include "Sampling.h"
+#include "Sampler.h"
+#include "GuideBuffers.h"
+#include "PathStats.h"
+#include <optional>
 
 inline float schlick(const float cos_theta, const float n1, const float n2) {
     if (fabs(n1 - n2) < 1e-4f) return 0.0f;
@@ -20,46 +26,76 @@ inline float schlick(const float cos_theta, const float n1, const float n2) {
     return r0 + (1.0f - r0) * pow(1.0f - cos_theta, 5.0f);
 }
 
-inline float randomValue(uint32_t& state){
-    state = state * 747796405u + 2891336453u;
-    uint32_t result = ((state >> ((state >> 28) + 4u)) ^ state) * 277803737u;
-    result = (result >> 22) ^ result;
-    return float(result) / 4294967295.0;
-}
-
 class Ray {
     private:
         float3 pos{};
         float3 dir{};
         float3 inv_dir{};
         int bounce;
-        float3 color{};
+        float3 throughput{}; // what the rest of the path is multiplied by
+        float3 radiance{}; // light collected so far
         std::vector<float> ior;
         bool mirror = true;
+        // The last bounce was diffuse and sampled the lights, so the light this path runs into
+        // next is weighted against those samples. bouncePos and bouncePdf are where that bounce
+        // happened and the pdf of the direction it chose.
+        bool sampledLights = false;
+        float3 bouncePos{};
+        float bouncePdf = 0;
+        bool diffuse = false; // set by handleCol when the bounce it chose is purely diffuse
+        FirstHit first;
+        float firstReflectance = 0; // the first hit's color and specular color mixed by how often each is picked, largest channel
+
+        const PathSettings* paths = nullptr;
+        PathEnd ended = PathEnd::BounceLimit;
+        // While a sample splits, the camera ray's hit is found once and kept for every branch
+        bool splitting = false, primaryKnown = false;
+        std::optional<HitInfo> primary;
+
+        // Every draw of a bounce has its own sampler dimension, so it lines up across samples
+        // even when a path skips some. The camera ray's pixel offset takes dimensions 0 and 1.
+        enum Draw { Roulette, Lobe, Transmission, Fresnel, Direction, LightPick = Direction + 2, LightPoint, Sun = LightPoint + 2, DrawsPerBounce = Sun + 2 };
+        int drawBase = 2;
+        [[nodiscard]] float draw(Sampler& sampler, const Draw draw) const {
+            sampler.setDimension(drawBase + draw);
+            return sampler.get1D();
+        }
+        [[nodiscard]] float2 draw2D(Sampler& sampler, const Draw draw) const {
+            sampler.setDimension(drawBase + draw);
+            return sampler.get2D();
+        }
 
     public:
         Ray() {
             this->pos = {0, 0, 0};
             this->dir = {0, 0, 1};
             this->bounce = 0;
-            this->color = {1, 1, 1};
+            this->throughput = {1, 1, 1};
             this->ior.push_back(1.0f);
         }
 
-        std::pair<float3, bool> trace(const float3& pos, const float3& dir, std::vector<Object*> const &bodies, const Floor* floor_data, const Sky* sky_data, const int bounceLim, uint32_t& state) {
-            updateStart(pos,dir);
-
-            for (int i = 0; i < bounceLim; i++) {
-                if (!updatePos(bodies, floor_data, sky_data, false, state)) {
-                    break;
-                }
-            }
-
-            if (this->bounce == bounceLim) {
-                this->color.clear();
+        // Radiance along dir, and whether the first hit was the sky seen directly or through mirrors.
+        // With splits the paths branching off the first hit are averaged, each one goes into stats.
+        std::pair<float3, bool> trace(const float3& pos, const float3& dir, std::vector<Object*> const &bodies, const Floor* floor_data, const Sky* sky_data, const std::vector<SphereLight>& lights, const int bounceLim, const PathSettings& paths, Sampler& sampler, PathStats& stats) {
+            this->paths = &paths;
+            splitting = paths.splits > 1;
+            primaryKnown = false;
+            const bool sky = tracePath(pos, dir, bodies, floor_data, sky_data, lights, bounceLim, sampler, stats);
+
+            // how many branches only depends on what the camera ray hit, not on the draws of the first
+            // path, or averaging them would favour some outcomes of it
+            if (!splitting or this->bounce == 0) return {this->radiance, sky};
+            const int splits = std::max(1, int(std::lround(float(paths.splits) * std::min(1.0f, firstReflectance))));
+            const FirstHit kept = first;
+            float3 sum = this->radiance;
+            for (int branch = 1; branch < splits; branch++) {
+                sampler.setBranch(branch);
+                tracePath(pos, dir, bodies, floor_data, sky_data, lights, bounceLim, sampler, stats);
+                sum += this->radiance;
             }
-
-            return {this->color, (this->bounce == 0 or mirror)};
+            sampler.setBranch(0);
+            first = kept;
+            return {sum / float(splits), sky};
         }
 
         void updateStart(const float3& pos, const float3& dir) {
@@ -68,35 +104,133 @@ class Ray {
             this->inv_dir = dir.invert();
             this->bounce = 0;
             this->mirror = true;
-            this->color = {1, 1, 1};
+            this->sampledLights = false;
+            this->throughput = {1, 1, 1};
+            this->radiance = {0, 0, 0};
+            this->first = {-dir, float3(1), FirstHit::skyDepth, 0, nullptr};
             this->ior.clear();
             this->ior.push_back(1.0f);
         }
 
-        bool updateColor(const Material* material, bool isSpecular) {
+        // What the camera ray hit, the albedo being what updateColor multiplies the throughput by
+        void recordFirstHit(const float3& normal, const float t, const Material* material, const bool isSpecular, const uint32_t object) {
+            if (this->bounce != 0) return;
+            const bool emitter = material->emission_color.mag() > 0;
+            first = {normal, emitter ? float3(1) : isSpecular ? material->specular_color : material->color, t, object, material};
+            const float3 reflectance = material->color.lerp(material->specular_color, material->specular_probability);
+            firstReflectance = std::max(reflectance.x, std::max(reflectance.y, reflectance.z));
+        }
+        // What the camera ray hit first, valid after trace
+        [[nodiscard]] const FirstHit& firstHit() const {
+            return first;
+        }
+
+        // Emitters end the path, weight is their multiple importance sampling weight
+        bool updateColor(const Material* material, bool isSpecular, const float weight = 1) {
             if (material->emission_color.mag() > 0) {
-                this->color *= material->emission_color;;
+                this->radiance += this->throughput * material->emission_color * weight;
                 return true;
             }
             if (isSpecular) {
-                this->color *= material->specular_color;
+                this->throughput *= material->specular_color;
             } else {
-                this->color *= material->color;
+                this->throughput *= material->color;
             }
             return false;
         }
 
-        [[nodiscard]] float3 reflect(const float3 normal, const float reflection, uint32_t& state) const {
+        // True if something sits between pos and distance along dir
+        static bool occluded(const float3& pos, const float3& dir, const float distance, std::vector<Object*> const &bodies, const Floor* floor_data) {
+            if (floor_data->active and dir.y < 0) {
+                const float t = (floor_data->height-pos.y)/dir.y;
+                if (0.01f < t and t < distance) return true;
+            }
+            const float3 inv_dir = dir.invert();
+            for (const Object *obj : bodies) {
+                const HitInfo* col = obj->checkCollision(pos, dir, inv_dir);
+                const bool blocks = col->getHit() and col->getT() < distance;
+                delete col;
+                if (blocks) return true;
+            }
+            return false;
+        }
+
+        // Next event estimation at a diffuse bounce: one sphere light picked at random, sampled
+        // over the cone it covers, and the sun, sampled from its falloff. Both are weighted
+        // against the diffuse bounce finding them with the power heuristic. The throughput
+        // already holds the surface color, so the diffuse brdf only adds 1/pi.
+        [[nodiscard]] float3 sampleLights(const float3& normal, std::vector<Object*> const &bodies, const Floor* floor_data, const Sky* sky_data, const std::vector<SphereLight>& lights, Sampler& sampler) const {
+            float3 light;
+            if (!lights.empty()) {
+                const int count = int(lights.size());
+                const SphereLight& sphere = lights[std::min(int(draw(sampler, LightPick) * float(count)), count - 1)];
+                float3 lightDir;
+                float solidAngle;
+                const float2 u = draw2D(sampler, LightPoint);
+                const float u1 = u.x, u2 = u.y;
+                float t;
+                float3 lightNormal;
+                if (sphere.sample(this->pos, u1, u2, lightDir, solidAngle) and lightDir.dot(normal) > 0 and
+                    Sphere::intersect(sphere.center, sphere.radius, this->pos, lightDir, t, lightNormal) and
+                    !occluded(this->pos, lightDir, t * 0.999f, bodies, floor_data)) {
+                    const float cosine = lightDir.dot(normal);
+                    const float lightPdf = 1.0f / (solidAngle * float(count));
+                    const float weight = powerHeuristic(lightPdf, cosine / float(M_PI));
+                    light += sphere.material->emission_color * (cosine / float(M_PI) / lightPdf * weight);
+                }
+            }
+            if (sky_data->hasSun()) {
+                const float2 u = draw2D(sampler, Sun);
+                const float3 sunDir = sky_data->sampleSun(u.x, u.y);
+                const float cosine = sunDir.dot(normal);
+                const float sunPdf = sky_data->sunPdf(sunDir);
+                if (cosine > 0 and sunPdf > 0 and !occluded(this->pos, sunDir, float(pow(10, 10)), bodies, floor_data)) {
+                    const float weight = powerHeuristic(sunPdf, cosine / float(M_PI));
+                    light += sky_data->getSun(sunDir) * (cosine / float(M_PI) / sunPdf * weight);
+                }
+            }
+            return this->throughput * light;
+        }
+        [[nodiscard]] static bool canSampleLights(const Sky* sky_data, const std::vector<SphereLight>& lights) {
+            return !lights.empty() or sky_data->hasSun();
+        }
+        // Weight of the sphere light a diffuse bounce ran into, against sampling it directly
+        [[nodiscard]] float lightWeight(const Material* material, const float3& hitPos, const std::vector<SphereLight>& lights) const {
+            if (!sampledLights or material->emission_color.mag() == 0) return 1;
+            const int index = findLight(lights, material, hitPos);
+            float cosMax;
+            if (index < 0 or !lights[index].cone(bouncePos, cosMax)) return 1;
+            const float lightPdf = 1.0f / (coneSolidAngle(cosMax) * float(lights.size()));
+            return powerHeuristic(bouncePdf, lightPdf);
+        }
+        // Remembers a bounce for lightWeight and sampleLights, the diffuse pdf is cos / pi
+        void diffuseBounce(const float3& normal, const Sky* sky_data, const std::vector<SphereLight>& lights) {
+            sampledLights = this->diffuse and canSampleLights(sky_data, lights);
+            bouncePos = this->pos;
+            bouncePdf = std::max(0.0f, this->dir.dot(normal)) / float(M_PI);
+        }
+
+        // onb is built around the normal once per hit
+        [[nodiscard]] float3 reflect(const Onb& onb, const float reflection, Sampler& sampler) const {
+            const float3& normal = onb.w;
             float3 reflect = this->dir-normal*2*this->dir.dot(normal);
-            const float3 random = (randPoint(state) + normal).normalize();
+            const float3 random = diffuseDir(onb, sampler);
             if (reflect.dot(normal) < 0) {
                 reflect = -reflect;
             }
             return random.lerp(reflect, reflection);
         }
 
-        [[nodiscard]] float3 handleCol(const float3  normal, const Material* material, bool isSpecular, uint32_t& state) {
-            if (randomValue(state) < material->transparency) {
+        [[nodiscard]] float3 diffuseDir(const Onb& onb, Sampler& sampler) const {
+            const float2 u = draw2D(sampler, Direction);
+            return sampleCosineHemisphere(onb, u.x, u.y).normalize(); // boxes hit from inside have no normal
+        }
+
+        [[nodiscard]] float3 handleCol(const Onb& onb, const Material* material, bool isSpecular, Sampler& sampler) {
+            const float3& normal = onb.w;
+            this->diffuse = material->smoothness * float(isSpecular) == 0;
+            if (draw(sampler, Transmission) < material->transparency) {
+                this->diffuse = material->smoothness == 0;
 
                 bool entering;
                 float m1;
@@ -119,9 +253,10 @@ class Ray {
                 const float cos_theta = -this->dir.dot(n);
 
                 const float reflect_prob = schlick(cos_theta, m1, m2);
-                if (randomValue(state) < reflect_prob) {
-                    return reflect(normal, material->smoothness, state);
+                if (draw(sampler, Fresnel) < reflect_prob) {
+                    return reflect(onb, material->smoothness, sampler);
                 }
+                this->diffuse = false;
 
                 const float3 r_out_perp = (this->dir + n * cos_theta) * eta;
 
@@ -131,7 +266,7 @@ class Ray {
                 }
                 if (k < 0.0f) {
                     // TIF
-                    return reflect(normal, material->smoothness, state);
+                    return reflect(onb, material->smoothness, sampler);
                 }
 
                 const float3 r_out_parallel = -n * std::sqrt(k);
@@ -143,17 +278,44 @@ class Ray {
                 } else {
                     this->ior.pop_back();
                 }
-                const float3 random = (randPoint(state)+normal).normalize();
+                const float3 random = diffuseDir(onb, sampler);
                 refracted = random.lerp(refracted, material->specular_probability);
 
                 return refracted;
 
             }
             else {
-                return reflect(normal, material->smoothness * float(isSpecular), state);
+                return reflect(onb, material->smoothness * float(isSpecular), sampler);
             }
         }
 
+        // One path from the camera, its length and end go into stats. True if it saw the sky
+        // directly or through mirrors.
+        bool tracePath(const float3& pos, const float3& dir, std::vector<Object*> const &bodies, const Floor* floor_data, const Sky* sky_data, const std::vector<SphereLight>& lights, const int bounceLim, Sampler& sampler, PathStats& stats) {
+            updateStart(pos,dir);
+            ended = PathEnd::BounceLimit; // kept unless updatePos ends the path first
+
+            for (int i = 0; i < bounceLim; i++) {
+                if (!updatePos(bodies, floor_data, sky_data, lights, false, sampler)) {
+                    break;
+                }
+            }
+
+            stats.add(this->bounce, ended);
+            return this->bounce == 0 or mirror;
+        }
+
+        // closest_collision, but the camera ray of a splitting sample only looks once
+        [[nodiscard]] HitInfo* cameraCollision(std::vector<Object*> const &bodies) {
+            if (!splitting) return closest_collision(bodies);
+            if (primaryKnown) return primary ? new HitInfo(*primary) : nullptr;
+            HitInfo* best = closest_collision(bodies);
+            primaryKnown = true;
+            if (best != nullptr) primary = *best;
+            else primary.reset();
+            return best;
+        }
+
         [[nodiscard]] HitInfo* closest_collision(std::vector<Object*> const &bodies) {
             HitInfo* best = nullptr;
             auto best_t = float(pow(10,10));
@@ -170,14 +332,15 @@ class Ray {
             return best;
         }
 
-        bool updatePos(std::vector<Object*> const &bodies, const Floor* floor_data, const Sky* sky_data, bool simple, uint32_t& state){
-            if (terminate(state)) {
+        bool updatePos(std::vector<Object*> const &bodies, const Floor* floor_data, const Sky* sky_data, const std::vector<SphereLight>& lights, bool simple, Sampler& sampler){
+            drawBase = 2 + this->bounce * DrawsPerBounce;
+            if (terminate(sampler)) {
                 mirror = false;
-                this->color.clear();
+                ended = PathEnd::Roulette;
                 return false;
             }
 
-            const HitInfo* best = closest_collision(bodies);
+            const HitInfo* best = this->bounce == 0 ? cameraCollision(bodies) : closest_collision(bodies);
 
             if (best != nullptr) {
                 if (simple) {
@@ -189,14 +352,17 @@ class Ray {
                     if (closest_collision(bodies) != nullptr) {
                         light = 0.0f;
                     }
-                    this->color = float3(light);
+                    this->radiance = float3(light);
                     delete best;
                     return false;
                 }
 
-                const bool isSpecular = best->getMaterial()->specular_probability > randomValue(state);
+                const bool isSpecular = best->getMaterial()->specular_probability > draw(sampler, Lobe);
+                recordFirstHit(best->getNormal(), best->getT(), best->getMaterial(), isSpecular, best->getObject());
 
-                if (updateColor(best->getMaterial(), isSpecular)) {
+                const float weight = lightWeight(best->getMaterial(), this->pos + this->dir*best->getT(), lights);
+                if (updateColor(best->getMaterial(), isSpecular, weight)) {
+                    ended = PathEnd::Emitter;
                     delete best;
                     return false;
                 }
@@ -208,9 +374,13 @@ class Ray {
                 this->bounce++;
 
                 this->pos += this->dir*best->getT();
-                this->dir = handleCol(best->getNormal(), best->getMaterial(), isSpecular, state);
+                const Onb onb(best->getNormal());
+                this->dir = handleCol(onb, best->getMaterial(), isSpecular, sampler);
                 this->inv_dir = this->dir.invert();
 
+                diffuseBounce(best->getNormal(), sky_data, lights);
+                if (sampledLights) this->radiance += sampleLights(best->getNormal(), bodies, floor_data, sky_data, lights, sampler);
+
                 delete best;
                 return true;
             }
@@ -240,8 +410,11 @@ class Ray {
                     if (color1) material = floor_data->material1;
                     else material = floor_data->material2;
 
-                    const bool isSpecular = material->specular_probability > randomValue(state);
+                    const bool isSpecular = material->specular_probability > draw(sampler, Lobe);
+                    static const uint32_t floorId = hashId(Hasher().add(std::string("floor")).get());
+                    recordFirstHit(normal, t, material, isSpecular, floorId);
                     if (updateColor(material, isSpecular)) {
+                        ended = PathEnd::Emitter;
                         delete best;
                         return false;
                     }
@@ -250,9 +423,13 @@ class Ray {
                         mirror = false;
                     }
 
-                    this->dir = reflect(normal, material->smoothness*float(isSpecular), state);
+                    this->dir = reflect(Onb(normal), material->smoothness*float(isSpecular), sampler);
                     this->inv_dir = this->dir.invert();
 
+                    this->diffuse = material->smoothness*float(isSpecular) == 0;
+                    diffuseBounce(normal, sky_data, lights);
+                    if (sampledLights) this->radiance += sampleLights(normal, bodies, floor_data, sky_data, lights, sampler);
+
                     this->bounce ++;
 
                     delete best;
@@ -260,38 +437,25 @@ class Ray {
                 }
             }
             if (sky_data->active) {
-                const float3 ev_color = sky_data->getSkyColor(this->dir);
-                this->color *= ev_color;
-            }
-            else {
-                this->color.clear();
+                // the sun was sampled at the last bounce if it was diffuse
+                const float weight = sampledLights and sky_data->hasSun() ? powerHeuristic(bouncePdf, sky_data->sunPdf(this->dir)) : 1;
+                this->radiance += this->throughput * (sky_data->getBackground(this->dir) + sky_data->getSun(this->dir) * weight);
             }
+            ended = PathEnd::Escaped;
             delete best;
             return false;
         }
 
-        bool terminate(uint32_t& state) {
-            if (this->bounce > 5) {
-                const float continue_prob = std::min(1.0f, this->color.sum()); // brightness-based
-                if (randomValue(state) > continue_prob) {
-                    //this->color = {1, 0, 0};
+        bool terminate(Sampler& sampler) {
+            if (this->bounce >= std::max(1, paths->rouletteStart)) {
+                const float continue_prob = std::min(1.0f, this->throughput.sum() / paths->survival); // brightness-based
+                if (draw(sampler, Roulette) > continue_prob) {
                     return true;
                 }
-                this->color *= (1.0f / continue_prob); // compensate
+                this->throughput *= (1.0f / continue_prob); // compensate
             }
             return false;
         }
-
-        static float3 randPoint(uint32_t& state) {
-            for (int i = 0; i < 10; i++) {
-                const float x = 2*randomValue(state)-1;
-                const float y = 2*randomValue(state)-1;
-                const float z = 2*randomValue(state)-1;
-                const float magnitude = float3(x, y, z).mag();
-                if (magnitude <= 1 and magnitude != 0) {return float3(x,y,z).normalize();}
-            }
-            return float3(1, 0, 0).normalize();
-        }
 };
 
 #endif //RAY_H
@@ -0,0 +1,70 @@
+//
+// Created by Andreas Royset on 10/18/26.
+//
+
+#ifndef RENDERBUDGET_H
+#define RENDERBUDGET_H
+
+#include <chrono>
+#include "Scene.h"
+
+// Decides when a frame has had enough iterations. iterations caps every frame, a time budget
+// stops it once the next iteration would run over, a noise target once the estimated error of
+// the image drops below it. Checked before every iteration.
+class RenderBudget {
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point frameStart, lastCheck, renderEnd;
+    double overhead = 0; // seconds the last frame took after rendering, held back from the next
+
+    static double seconds(const Clock::duration duration) {
+        return std::chrono::duration<double>(duration).count();
+    }
+
+    public:
+    enum class Stop { Running, Iterations, Time, Noise };
+
+    int iterations;
+    float timeBudget, noiseTarget;
+
+    RenderBudget(const int iterations, const float timeBudget, const float noiseTarget)
+        : iterations(iterations), timeBudget(timeBudget), noiseTarget(noiseTarget) {
+        startFrame();
+    }
+
+    // The frame's time starts here, setting it up counts against the budget too
+    void startFrame() {
+        frameStart = lastCheck = Clock::now();
+    }
+    // After the frame is denoised and written, what that took is left out of the next frame's
+    // rendering time so whole frames keep to the budget
+    void endFrame() {
+        overhead = seconds(Clock::now() - renderEnd);
+    }
+
+    [[nodiscard]] Stop check(const Scene& scene) {
+        const Clock::time_point now = Clock::now();
+        // the next iteration should take about as long as the last, they only get cheaper as
+        // adaptive sampling retires pixels
+        const double iteration = seconds(now - lastCheck);
+        lastCheck = now;
+
+        Stop stop = Stop::Running;
+        if (scene.iterations >= iterations) stop = Stop::Iterations;
+        else if (timeBudget > 0 and scene.iterations > 0 and seconds(now - frameStart) + iteration + overhead > timeBudget) stop = Stop::Time;
+        // like converged(), every pixel needs a few samples before its variance means anything
+        else if (noiseTarget > 0 and scene.iterations >= scene.antialiasing * scene.antialiasing and scene.imageNoise() < noiseTarget) stop = Stop::Noise;
+        if (stop != Stop::Running) renderEnd = now;
+        return stop;
+    }
+
+    static const char* describe(const Stop stop) {
+        switch (stop) {
+            case Stop::Iterations: return "iteration limit";
+            case Stop::Time: return "time budget";
+            case Stop::Noise: return "noise target";
+            default: return "running";
+        }
+    }
+};
+
+#endif //RENDERBUDGET_H
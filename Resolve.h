@@ -0,0 +1,84 @@
+//
+// Created by Andreas Royset on 10/18/26.
+//
+
+#ifndef RESOLVE_H
+#define RESOLVE_H
+
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "Image.h"
+#include "AccumBuffer.h"
+#include "Parallel.h"
+#include "int2.h"
+
+struct NoTonemap {
+    static float apply(const float x) { return x; }
+};
+template <TransferMode mode = TransferMode::Exact>
+struct AcesTonemap {
+    static float apply(const float x) { return acesT<mode>(x); }
+};
+
+// Shared body of the resolve overloads. pixel(index, c) returns the summed radiance of one
+// channel and count(index) its sample count.
+template <typename Tonemap, typename T, TransferMode gamma, typename Pixel, typename Count>
+std::vector<T> resolvePixels(const int2 size, const Image* bloom, const Pixel& pixel, const Count& count) {
+    static_assert(std::is_same_v<T, unsigned char> or std::is_same_v<T, uint16_t>, "8 or 16 bit output only");
+    constexpr float scale = std::is_same_v<T, unsigned char> ? 1.0f : 65535.0f / 255.0f;
+
+    std::vector<T> out(size_t(size.x) * size.y * 3);
+    const float* glow = bloom == nullptr ? nullptr : bloom->getData()->data();
+    const int glowWidth = bloom == nullptr ? 0 : bloom->getSize().x;
+    T* dst = out.data();
+
+    parallelFor(size.y, [&](const int begin, const int end) {
+        for (int y = begin; y < end; y++) {
+            const float* glowRow = glow == nullptr ? nullptr : glow + size_t(y) * glowWidth * 3;
+            T* rowOut = dst + size_t(y) * size.x * 3;
+
+            for (int x = 0; x < size.x; x++) {
+                const size_t index = size_t(y) * size.x + x;
+                const int n = count(index);
+                const float inv = n == 0 ? 0.0f : 1.0f / float(n);
+                for (int c = 0; c < 3; c++) {
+                    float v = Tonemap::apply(pixel(index, c) * inv);
+                    if (glowRow != nullptr) v += glowRow[x*3+c];
+                    rowOut[x*3+c] = T(linearizeT<gamma>(v) * scale);
+                }
+            }
+        }
+    });
+    return out;
+}
+
+// Turns the accumulation buffer into final pixels in one pass: divide by the sample count,
+// tonemap, add bloom, gamma correct and quantize. T is unsigned char or uint16_t.
+// bloom may be nullptr, otherwise it must be at least as large as accum.
+template <typename Tonemap = NoTonemap, typename T = unsigned char, TransferMode gamma = TransferMode::Exact>
+std::vector<T> resolve(const Image& accum, const std::vector<int>& samples, const Image* bloom) {
+    const float* src = accum.getData()->data();
+    const int* counts = samples.data();
+    return resolvePixels<Tonemap, T, gamma>(accum.getSize(), bloom,
+        [src](const size_t index, const int c) { return src[index*3+c]; },
+        [counts](const size_t index) { return counts[index]; });
+}
+// An already averaged frame, like the denoiser's output
+template <typename Tonemap = NoTonemap, typename T = unsigned char, TransferMode gamma = TransferMode::Exact>
+std::vector<T> resolve(const Image& average, const Image* bloom) {
+    const float* src = average.getData()->data();
+    return resolvePixels<Tonemap, T, gamma>(average.getSize(), bloom,
+        [src](const size_t index, const int c) { return src[index*3+c]; },
+        [](size_t) { return 1; });
+}
+template <typename Tonemap = NoTonemap, typename T = unsigned char, TransferMode gamma = TransferMode::Exact>
+std::vector<T> resolve(const AccumBuffer& accum, const Image* bloom) {
+    const AccumPixel* src = accum.data();
+    return resolvePixels<Tonemap, T, gamma>(accum.getSize(), bloom,
+        [src](const size_t index, const int c) { return c == 0 ? src[index].r : c == 1 ? src[index].g : src[index].b; },
+        [src](const size_t index) { return int(src[index].samples); });
+}
+
+#endif //RESOLVE_H
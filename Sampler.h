@@ -0,0 +1,345 @@
+//
+// Created by Andreas Royset on 10/18/26.
+//
+
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <vector>
+#include "float2.h"
+
+enum class SamplerType : int32_t { Random, Sobol, Stratified, BlueNoise };
+
+namespace sampling {
+
+inline uint32_t hash(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+inline uint32_t hash(const uint32_t a, const uint32_t b) {
+    return hash(a ^ (hash(b) + 0x9e3779b9u + (a << 6) + (a >> 2)));
+}
+// 24 bits, so the result stays below 1
+inline float toUnit(const uint32_t x) {
+    return float(x >> 8) * (1.0f / 16777216.0f);
+}
+
+inline uint32_t reverseBits(uint32_t x) {
+    x = (x << 16) | (x >> 16);
+    x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+    x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+    x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+    x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+    return x;
+}
+// Owen scrambling by hashing, Burley 2020, "Practical Hash-based Owen Scrambling"
+inline uint32_t laineKarrasPermutation(uint32_t x, const uint32_t seed) {
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return x;
+}
+inline uint32_t nestedUniformScramble(const uint32_t x, const uint32_t seed) {
+    return reverseBits(laineKarrasPermutation(reverseBits(x), seed));
+}
+// The first two Sobol dimensions, van der Corput and the one made of Pascal's triangle
+inline uint32_t sobol0(const uint32_t index) {
+    return reverseBits(index);
+}
+inline uint32_t sobol1(const uint32_t index) {
+    // the shuffled indices use all 32 bits, so the generator matrix is applied a byte at a time
+    static const std::array<std::array<uint32_t, 256>, 4> table = [] {
+        std::array<std::array<uint32_t, 256>, 4> bytes{};
+        uint32_t columns[32];
+        columns[0] = 1u << 31;
+        for (int i = 1; i < 32; i++) columns[i] = columns[i - 1] ^ (columns[i - 1] >> 1);
+        for (int b = 0; b < 4; b++) {
+            for (uint32_t value = 0; value < 256; value++) {
+                for (int bit = 0; bit < 8; bit++) {
+                    if (value >> bit & 1) bytes[b][value] ^= columns[8 * b + bit];
+                }
+            }
+        }
+        return bytes;
+    }();
+    return table[0][index & 255] ^ table[1][(index >> 8) & 255] ^ table[2][(index >> 16) & 255] ^ table[3][index >> 24];
+}
+
+// Element i of a random permutation of 0..length-1, Kensler 2013, "Correlated Multi-Jittered Sampling"
+inline uint32_t permute(uint32_t i, const uint32_t length, const uint32_t seed) {
+    uint32_t w = length - 1;
+    w |= w >> 1;
+    w |= w >> 2;
+    w |= w >> 4;
+    w |= w >> 8;
+    w |= w >> 16;
+    do {
+        i ^= seed;
+        i *= 0xe170893du;
+        i ^= seed >> 16;
+        i ^= (i & w) >> 4;
+        i ^= seed >> 8;
+        i *= 0x0929eb3fu;
+        i ^= seed >> 23;
+        i ^= (i & w) >> 1;
+        i *= 1 | seed >> 27;
+        i *= 0x6935fa69u;
+        i ^= (i & w) >> 11;
+        i *= 0x74dcb303u;
+        i ^= (i & w) >> 2;
+        i *= 0x9e501cc3u;
+        i ^= (i & w) >> 2;
+        i *= 0xc860a3dfu;
+        i &= w;
+        i ^= i >> 5;
+    } while (i >= length);
+    return (i + seed) % length;
+}
+
+// A tileable blue noise mask by void and cluster, Ulichney 1993. Values are the rank of
+// each pixel, spread evenly over [0, 1).
+class BlueNoiseMask {
+    std::vector<float> ranks;
+
+    public:
+    static constexpr int size = 64;
+
+    BlueNoiseMask() {
+        constexpr int count = size * size;
+        constexpr float sigma = 1.5f;
+        std::vector<float> kernel(count);
+        for (int y = 0; y < size; y++) {
+            for (int x = 0; x < size; x++) {
+                const int dx = std::min(x, size - x), dy = std::min(y, size - y);
+                kernel[y * size + x] = std::exp(-float(dx * dx + dy * dy) / (2 * sigma * sigma));
+            }
+        }
+        std::vector<char> ones(count, 0);
+        std::vector<float> energy(count, 0);
+        const auto toggle = [&](const int index, const bool on) {
+            ones[index] = on;
+            const int px = index % size, py = index / size;
+            const float sign = on ? 1.0f : -1.0f;
+            for (int y = 0; y < size; y++) {
+                for (int x = 0; x < size; x++) {
+                    energy[y * size + x] += sign * kernel[((y - py + size) % size) * size + (x - px + size) % size];
+                }
+            }
+        };
+        // the tightest cluster is the one with the most energy, the largest void the least
+        const auto extreme = [&](const bool ofOnes) {
+            int best = -1;
+            for (int i = 0; i < count; i++) {
+                if (bool(ones[i]) != ofOnes) continue;
+                if (best < 0 or (ofOnes ? energy[i] > energy[best] : energy[i] < energy[best])) best = i;
+            }
+            return best;
+        };
+
+        // a random start with a tenth of the pixels set, relaxed until moving a point changes nothing
+        std::mt19937 random(1);
+        int initial = 0;
+        while (initial < count / 10) {
+            const int index = int(random() % count);
+            if (!ones[index]) {
+                toggle(index, true);
+                initial++;
+            }
+        }
+        for (int pass = 0; pass < count; pass++) {
+            const int cluster = extreme(true);
+            toggle(cluster, false);
+            const int voidIndex = extreme(false);
+            toggle(voidIndex, true);
+            if (voidIndex == cluster) break;
+        }
+        const std::vector<char> start = ones;
+        const std::vector<float> startEnergy = energy;
+
+        std::vector<int> rank(count);
+        for (int r = initial - 1; r >= 0; r--) { // take clusters away for the lower ranks
+            const int cluster = extreme(true);
+            toggle(cluster, false);
+            rank[cluster] = r;
+        }
+        ones = start;
+        energy = startEnergy;
+        for (int r = initial; r < count; r++) { // fill voids for the higher ranks
+            const int voidIndex = extreme(false);
+            toggle(voidIndex, true);
+            rank[voidIndex] = r;
+        }
+        ranks.resize(count);
+        for (int i = 0; i < count; i++) ranks[i] = (float(rank[i]) + 0.5f) / float(count);
+    }
+
+    [[nodiscard]] float at(const int x, const int y) const {
+        return ranks[(y & (size - 1)) * size + (x & (size - 1))];
+    }
+    static const BlueNoiseMask& get() {
+        static const BlueNoiseMask mask;
+        return mask;
+    }
+};
+
+} // namespace sampling
+
+// Random numbers for one pixel sample at a time. Every draw takes the next dimension, so
+// draw n of every sample of a pixel comes from the same sequence. Ray sets the dimension
+// at each bounce so the draws line up even when a path skips some.
+class Sampler {
+    protected:
+    int x = 0, y = 0;
+    uint32_t pixelSeed = 0;
+    uint32_t frameSeed = 0; // the seed start was given, shared by every pixel
+    uint32_t sampleIndex = 0;
+    uint32_t dimension = 0;
+    uint32_t rootSeed = 0, branch = 0;
+
+    public:
+    virtual ~Sampler() = default;
+
+    void start(const int x, const int y, const int sampleIndex, const uint32_t seed) {
+        this->x = x;
+        this->y = y;
+        frameSeed = seed;
+        pixelSeed = rootSeed = sampling::hash(sampling::hash(uint32_t(x), uint32_t(y)), seed);
+        this->sampleIndex = uint32_t(sampleIndex);
+        dimension = 0;
+        branch = 0;
+    }
+    // Another path split off the same pixel sample, with its own scramble of every dimension.
+    // Branch 0 is the sample's own path.
+    void setBranch(const int branch) {
+        this->branch = uint32_t(branch);
+        pixelSeed = branch == 0 ? rootSeed : sampling::hash(rootSeed, this->branch);
+    }
+    void setDimension(const int dimension) {
+        this->dimension = uint32_t(dimension);
+    }
+
+    virtual float get1D() = 0;
+    virtual float2 get2D() = 0;
+};
+
+// Independent uniform numbers, a hash of pixel, sample and dimension
+class RandomSampler : public Sampler {
+    [[nodiscard]] float next() {
+        return sampling::toUnit(sampling::hash(sampling::hash(pixelSeed, sampleIndex), dimension++));
+    }
+
+    public:
+    float get1D() override {
+        return next();
+    }
+    float2 get2D() override {
+        const float u = next();
+        return {u, next()};
+    }
+};
+
+// Owen scrambled Sobol points, padded: every dimension pair uses the first two Sobol
+// dimensions with its own scramble and its own shuffle of the sample order
+class SobolSampler : public Sampler {
+    public:
+    float get1D() override {
+        const uint32_t seed = sampling::hash(pixelSeed, dimension++);
+        const uint32_t index = sampling::nestedUniformScramble(sampleIndex, seed);
+        return sampling::toUnit(sampling::nestedUniformScramble(sampling::sobol0(index), sampling::hash(seed, 1)));
+    }
+    float2 get2D() override {
+        const uint32_t seed = sampling::hash(pixelSeed, dimension);
+        dimension += 2;
+        const uint32_t index = sampling::nestedUniformScramble(sampleIndex, seed);
+        return {sampling::toUnit(sampling::nestedUniformScramble(sampling::sobol0(index), sampling::hash(seed, 1))),
+                sampling::toUnit(sampling::nestedUniformScramble(sampling::sobol1(index), sampling::hash(seed, 2)))};
+    }
+};
+
+// Jittered strata over the frame's planned samples, padded: every dimension visits the
+// strata in its own random order. Samples past the plan are plain random.
+class StratifiedSampler : public Sampler {
+    uint32_t samples;
+    uint32_t columns, rows;
+
+    [[nodiscard]] float jitter(const uint32_t seed) const {
+        return sampling::toUnit(sampling::hash(seed, sampleIndex));
+    }
+
+    public:
+    explicit StratifiedSampler(const int samples) : samples(uint32_t(std::max(1, samples))) {
+        columns = uint32_t(std::ceil(std::sqrt(float(this->samples))));
+        rows = (this->samples + columns - 1) / columns;
+    }
+
+    float get1D() override {
+        const uint32_t seed = sampling::hash(pixelSeed, dimension++);
+        if (sampleIndex >= samples) return jitter(seed);
+        const uint32_t stratum = sampling::permute(sampleIndex, samples, seed);
+        return (float(stratum) + jitter(seed ^ 0x5bd1e995u)) / float(samples);
+    }
+    float2 get2D() override {
+        const uint32_t seed = sampling::hash(pixelSeed, dimension);
+        dimension += 2;
+        if (sampleIndex >= samples) return {jitter(seed), jitter(seed ^ 0x5bd1e995u)};
+        const uint32_t cell = sampling::permute(sampleIndex, columns * rows, seed);
+        return {(float(cell % columns) + jitter(seed ^ 0x68e31da4u)) / float(columns),
+                (float(cell / columns) + jitter(seed ^ 0xb5297a4du)) / float(rows)};
+    }
+};
+
+// Owen scrambled Sobol points like SobolSampler, but with one scramble per frame instead of
+// per pixel, every pixel rotated (Cranley-Patterson) by a blue noise mask. Neighbouring pixels
+// get far apart rotations of the same points, so the error left in the frame is blue noise
+// instead of white. Every dimension reads the mask at its own toroidal offset, from the seed.
+class BlueNoiseSampler : public Sampler {
+    const sampling::BlueNoiseMask& mask = sampling::BlueNoiseMask::get();
+
+    [[nodiscard]] uint32_t scramble(const uint32_t dim) const {
+        return sampling::hash(sampling::hash(frameSeed, dim), branch);
+    }
+    [[nodiscard]] float rotate(const uint32_t point, const uint32_t seed) const {
+        const uint32_t offset = sampling::hash(seed, 0x2545f491u);
+        const float value = sampling::toUnit(point) + mask.at(x + int(offset & 63u), y + int((offset >> 6) & 63u));
+        return value < 1.0f ? value : value - 1.0f;
+    }
+
+    public:
+    float get1D() override {
+        const uint32_t seed = scramble(dimension++);
+        const uint32_t index = sampling::nestedUniformScramble(sampleIndex, seed);
+        return rotate(sampling::nestedUniformScramble(sampling::sobol0(index), sampling::hash(seed, 1)), seed);
+    }
+    float2 get2D() override {
+        const uint32_t seed = scramble(dimension);
+        dimension += 2;
+        const uint32_t index = sampling::nestedUniformScramble(sampleIndex, seed);
+        return {rotate(sampling::nestedUniformScramble(sampling::sobol0(index), sampling::hash(seed, 1)), seed),
+                rotate(sampling::nestedUniformScramble(sampling::sobol1(index), sampling::hash(seed, 2)), sampling::hash(seed, 3))};
+    }
+};
+
+// samples is how many the frame is planned to get, only stratified sampling needs it
+inline std::unique_ptr<Sampler> makeSampler(const SamplerType type, const int samples) {
+    switch (type) {
+        case SamplerType::Random: return std::make_unique<RandomSampler>();
+        case SamplerType::Stratified: return std::make_unique<StratifiedSampler>(samples);
+        case SamplerType::BlueNoise: return std::make_unique<BlueNoiseSampler>();
+        case SamplerType::Sobol: break;
+    }
+    return std::make_unique<SobolSampler>();
+}
+
+#endif //SAMPLER_H
@@ -0,0 +1,79 @@
+//
+// Created by Andreas Royset on 10/18/26.
+//
+
+#ifndef SAMPLING_H
+#define SAMPLING_H
+
+#include <algorithm>
+#include <cmath>
+#include "float3.h"
+
+// Orthonormal basis around a unit vector w, without branches on the sign of w.z
+// (Duff et al. 2017)
+struct Onb {
+    float3 u, v, w;
+
+    explicit Onb(const float3& w) : w(w) {
+        const float sign = std::copysign(1.0f, w.z);
+        const float a = -1.0f / (sign + w.z);
+        const float b = w.x * w.y * a;
+        u = {1.0f + sign * w.x * w.x * a, sign * b, -sign * w.x};
+        v = {b, sign + w.y * w.y * a, -w.y};
+    }
+
+    [[nodiscard]] float3 toWorld(const float x, const float y, const float z) const {
+        return u * x + v * y + w * z;
+    }
+};
+
+// Cosine weighted direction around onb.w, pdf cos / pi (Malley's method)
+inline float3 sampleCosineHemisphere(const Onb& onb, const float u1, const float u2) {
+    const float r = std::sqrt(u1);
+    const float phi = 2.0f * float(M_PI) * u2;
+    return onb.toWorld(r * std::cos(phi), r * std::sin(phi), std::sqrt(std::max(0.0f, 1.0f - u1)));
+}
+// Uniform direction around onb.w, pdf 1 / 2pi
+inline float3 sampleUniformHemisphere(const Onb& onb, const float u1, const float u2) {
+    const float r = std::sqrt(std::max(0.0f, 1.0f - u1 * u1));
+    const float phi = 2.0f * float(M_PI) * u2;
+    return onb.toWorld(r * std::cos(phi), r * std::sin(phi), u1);
+}
+// Uniform direction, pdf 1 / 4pi
+inline float3 sampleUniformSphere(const float u1, const float u2) {
+    const float z = 1.0f - 2.0f * u1;
+    const float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+    const float phi = 2.0f * float(M_PI) * u2;
+    return {r * std::cos(phi), r * std::sin(phi), z};
+}
+
+// Uniform direction within angle acos(cosMax) of onb.w, the pdf is 1 / coneSolidAngle(cosMax)
+inline float3 sampleCone(const Onb& onb, const float cosMax, const float u1, const float u2) {
+    const float cosTheta = 1.0f - u1 * (1.0f - cosMax);
+    const float sinTheta = std::sqrt(std::max(0.0f, 1.0f - cosTheta * cosTheta));
+    const float phi = 2.0f * float(M_PI) * u2;
+    return onb.toWorld(std::cos(phi) * sinTheta, std::sin(phi) * sinTheta, cosTheta);
+}
+inline float coneSolidAngle(const float cosMax) {
+    return 2.0f * float(M_PI) * (1.0f - cosMax);
+}
+
+// Direction around onb.w with density proportional to cos^exponent, like a Phong lobe
+inline float3 sampleCosinePower(const Onb& onb, const float exponent, const float u1, const float u2) {
+    const float cosTheta = std::pow(u1, 1.0f / (exponent + 1.0f));
+    const float sinTheta = std::sqrt(std::max(0.0f, 1.0f - cosTheta * cosTheta));
+    const float phi = 2.0f * float(M_PI) * u2;
+    return onb.toWorld(std::cos(phi) * sinTheta, std::sin(phi) * sinTheta, cosTheta);
+}
+inline float cosinePowerPdf(const float cosTheta, const float exponent) {
+    if (cosTheta <= 0) return 0;
+    return (exponent + 1.0f) / (2.0f * float(M_PI)) * std::pow(cosTheta, exponent);
+}
+
+// Power heuristic with beta 2 for two strategies taking one sample each
+inline float powerHeuristic(const float pdf, const float otherPdf) {
+    const float a = pdf * pdf, b = otherPdf * otherPdf;
+    return a + b > 0 ? a / (a + b) : 0;
+}
+
+#endif //SAMPLING_H
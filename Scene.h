@@ -5,6 +5,10 @@
 #ifndef SCENE_H
 #define SCENE_H
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
 #include <utility>
 #include <vector>
 #include "float3.h"
@@ -13,6 +17,46 @@
 #include "Object.h"
 #include "Camera.h"
 #include "Image.h"
+#include "AccumBuffer.h"
+#include "Checkpoint.h"
+#include "Hash.h"
+#include "Sampler.h"
+#include "GuideBuffers.h"
+#include "PathStats.h"
+
+// Welford's running mean and variance of one pixel's luminance
+struct PixelVariance {
+    float mean = 0;
+    float m2 = 0;
+    int samples = 0;
+
+    void add(const float x) {
+        samples++;
+        const float delta = x - mean;
+        mean += delta / float(samples);
+        m2 += delta * (x - mean);
+    }
+    // Standard error of the mean relative to the mean, dark pixels are measured against 1/255.
+    // A pixel that never varied hasn't shown its error yet, all black pixels are often just
+    // waiting for a rare path to light.
+    [[nodiscard]] float relativeError() const {
+        if (samples < 2 or m2 <= 0) return 1;
+        return standardError() / std::max(mean, 1.0f);
+    }
+    [[nodiscard]] float standardError() const {
+        if (samples < 2) return 0;
+        return std::sqrt(std::max(m2, 0.0f) / float(samples - 1) / float(samples));
+    }
+    // Takes in the samples other summarizes, as if they had been added one by one (Chan et al.)
+    void merge(const PixelVariance& other) {
+        if (other.samples == 0) return;
+        const int total = samples + other.samples;
+        const float delta = other.mean - mean;
+        mean += delta * float(other.samples) / float(total);
+        m2 += other.m2 + delta * delta * float(samples) * float(other.samples) / float(total);
+        samples = total;
+    }
+};
 
 class Scene {
 public:
@@ -20,6 +64,7 @@ public:
     Camera camera;
     int antialiasing;
     std::vector<Object*> bodies;
+    std::vector<SphereLight> lights; // gathered from bodies once
     Floor* floor_data;
     Sky* sky_data;
     int tileSize;
@@ -28,6 +73,22 @@ public:
     std::vector<float> prob;
     int iterations;
     int bounceLim;
+    // packed keeps color, sample count and the active flag in accum instead of the three buffers above
+    bool packed = false;
+    AccumBuffer accum;
+    Checkpoint checkpoint;
+    // pixels stop once relativeError() drops below this, 0 keeps every pixel sampling
+    float adaptiveThreshold = 0;
+    std::vector<PixelVariance> variance; // empty unless adaptive sampling or a noise target needs it
+    // the pixels each tile still samples, rebuilt by reset() and compacted by renderTile
+    std::vector<std::vector<int>> activeTiles;
+    // roulette and splitting, and what the frame's paths did per tile, cleared with the tiles
+    PathSettings paths;
+    std::vector<PathStats> tileStats;
+    SamplerType samplerType = SamplerType::Sobol;
+    int plannedSamples = 1; // samples a frame is meant to get, the stratified sampler divides them up
+    // first hit normal, albedo and depth for the denoiser, empty unless it runs
+    GuideBuffers guides;
 
     Scene(
           const int width,
@@ -53,6 +114,8 @@ public:
         colorBuffer.clear({width, height}
     );
         iterations = 0;
+        buildTiles();
+        for (const Object* body : this->bodies) body->lights(lights);
     }
 
     Scene(
@@ -79,13 +142,212 @@ public:
     {
         colorBuffer.clear({width,height});
         iterations = 0;
+        buildTiles();
+        for (const Object* body : this->bodies) body->lights(lights);
     }
 
     void reset() {
-        colorBuffer.clear();
-        sampleCount = std::vector<int>(width * height, 0);
-        prob = std::vector<float>(width * height, 1);
+        if (packed) {
+            accum.clear();
+        } else {
+            colorBuffer.clear();
+            sampleCount = std::vector<int>(width * height, 0);
+            prob = std::vector<float>(width * height, 1);
+        }
+        if (!variance.empty()) variance.assign(size_t(width) * height, PixelVariance());
+        if (!guides.empty()) guides.reset(size_t(width) * height);
+        iterations = 0;
+        buildTiles();
+    }
+
+    void setPacked(const bool packed) {
+        this->packed = packed;
+        if (packed) {
+            colorBuffer.clear({0, 0});
+            sampleCount = std::vector<int>();
+            prob = std::vector<float>();
+            accum = AccumBuffer({width, height});
+        } else {
+            accum = AccumBuffer();
+            colorBuffer.clear({width, height});
+            sampleCount = std::vector<int>(width * height, 0);
+            prob = std::vector<float>(width * height, 1);
+        }
+        buildTiles();
+    }
+
+    void setGuided(const bool guided) {
+        if (guided) guides.reset(size_t(width) * height);
+        else guides.clear();
+    }
+    void addGuide(const int index, const FirstHit& hit) {
+        if (!guides.empty()) guides.add(index, hit);
+    }
+
+    void setAdaptive(const float threshold) {
+        adaptiveThreshold = threshold;
+        variance.assign(threshold > 0 ? size_t(width) * height : 0, PixelVariance());
+    }
+    // Keeps the variance without stopping pixels, for imageNoise()
+    void trackVariance() {
+        if (variance.empty()) variance.assign(size_t(width) * height, PixelVariance());
+    }
+
+    // Every active pixel of every tile, row by row within a tile
+    void buildTiles() {
+        const int tilesX = (width + tileSize - 1) / tileSize;
+        const int tilesY = (height + tileSize - 1) / tileSize;
+        activeTiles.assign(size_t(tilesX) * tilesY, {});
+        tileStats.assign(activeTiles.size(), PathStats());
+        for (int tileY = 0; tileY < tilesY; tileY++) {
+            for (int tileX = 0; tileX < tilesX; tileX++) {
+                std::vector<int>& tile = activeTiles[tileY * tilesX + tileX];
+                for (int y = tileY * tileSize; y < std::min(height, (tileY + 1) * tileSize); y++) {
+                    for (int x = tileX * tileSize; x < std::min(width, (tileX + 1) * tileSize); x++) {
+                        if (isActive(y * width + x)) tile.push_back(y * width + x);
+                    }
+                }
+            }
+        }
+    }
+    // The tile starting at pixel x, y
+    [[nodiscard]] std::vector<int>& activePixels(const int x, const int y) {
+        const int tilesX = (width + tileSize - 1) / tileSize;
+        return activeTiles[(y / tileSize) * tilesX + x / tileSize];
+    }
+    [[nodiscard]] PathStats& tilePaths(const int x, const int y) {
+        const int tilesX = (width + tileSize - 1) / tileSize;
+        return tileStats[(y / tileSize) * tilesX + x / tileSize];
+    }
+    [[nodiscard]] PathStats pathStats() const {
+        PathStats total;
+        for (const PathStats& tile : tileStats) total.merge(tile);
+        return total;
+    }
+    [[nodiscard]] size_t activeCount() const {
+        size_t count = 0;
+        for (const std::vector<int>& tile : activeTiles) count += tile.size();
+        return count;
+    }
+
+    void addSample(const int x, const int y, const float3 color) {
+        if (!variance.empty()) variance[y * width + x].add(0.2126f * color.x + 0.7152f * color.y + 0.0722f * color.z);
+        if (packed) {
+            accum.add(y * width + x, color);
+            return;
+        }
+        colorBuffer.add(x, y, color);
+        sampleCount[y * width + x]++;
+    }
+    // Samples carried over from an earlier frame, color being their average and spread their
+    // variance
+    void addHistory(const int index, const float3 color, const int samples, const PixelVariance& spread) {
+        if (!variance.empty()) variance[index].merge(spread);
+        if (packed) {
+            accum.add(index, color * float(samples), samples);
+            return;
+        }
+        colorBuffer.add(index % width, index / width, color * float(samples));
+        sampleCount[index] += samples;
+    }
+    [[nodiscard]] int samples(const int index) const {
+        return packed ? accum.samples(index) : sampleCount[index];
+    }
+    [[nodiscard]] bool isActive(const int index) const {
+        return packed ? accum.isActive(index) : bool(int(prob[index]));
+    }
+    void deactivate(const int index) {
+        if (packed) accum.deactivate(index);
+        else prob[index] = 0;
+    }
+    [[nodiscard]] Image averageImage() const {
+        if (packed) return accum.averageImage();
+        Image image = colorBuffer;
+        image.divide(sampleCount);
+        return image;
+    }
+    [[nodiscard]] std::vector<float> activeMask() const {
+        return packed ? accum.activeMask() : prob;
+    }
+    // True once the pixel's error is below the threshold. Until 1/threshold samples, and at least
+    // every antialiasing offset, a pixel that only ever saw black could still be lit by rare paths.
+    [[nodiscard]] bool converged(const int index) const {
+        if (adaptiveThreshold <= 0) return false;
+        const PixelVariance& pixel = variance[index];
+        const int minSamples = std::max(antialiasing * antialiasing, int(std::ceil(1 / adaptiveThreshold)));
+        return pixel.samples >= minSamples and pixel.relativeError() < adaptiveThreshold;
+    }
+    // Estimated error of the whole frame, the per pixel standard error relative to the pixel
+    // like relativeError(), averaged. Pixels that never varied count as done here, for the
+    // frame the rare path they could be missing matters little. 1 without variance.
+    [[nodiscard]] float imageNoise() const {
+        if (variance.empty()) return 1;
+        double sum = 0;
+        size_t pixels = 0;
+        for (const PixelVariance& pixel : variance) {
+            if (pixel.samples == 0) continue;
+            sum += pixel.standardError() / std::max(pixel.mean, 1.0f);
+            pixels++;
+        }
+        return pixels > 0 ? float(sum / double(pixels)) : 1;
+    }
+    [[nodiscard]] double meanSamples() const {
+        double total = 0;
+        for (int i = 0; i < width * height; i++) total += samples(i);
+        return total / double(std::max(1, width * height));
+    }
+    // Samples per pixel scaled so the most sampled pixel is 1
+    [[nodiscard]] std::vector<float> sampleDistribution() const {
+        std::vector<float> distribution(size_t(width) * height);
+        int most = 1;
+        for (size_t i = 0; i < distribution.size(); i++) most = std::max(most, packed ? accum.samples(int(i)) : sampleCount[i]);
+        for (size_t i = 0; i < distribution.size(); i++) distribution[i] = float(packed ? accum.samples(int(i)) : sampleCount[i]) / float(most);
+        return distribution;
+    }
+
+    // Everything that changes the pixels of the current frame
+    [[nodiscard]] uint64_t hash() const {
+        Hasher hasher;
+        hasher.add(width).add(height).add(antialiasing).add(bounceLim).add(tileSize);
+        if (adaptiveThreshold > 0) hasher.add(adaptiveThreshold);
+        hasher.add(int32_t(samplerType));
+        if (samplerType == SamplerType::Stratified) hasher.add(plannedSamples);
+        if (paths != PathSettings()) hasher.add(paths.rouletteStart).add(paths.survival).add(paths.splits);
+        camera.hash(hasher);
+        for (const Object* body : bodies) body->hash(hasher);
+        floor_data->hash(hasher);
+        sky_data->hash(hasher);
+        return hasher.get();
+    }
+
+    // Replaces reset() when checkpointing: switches to packed buffers kept in the file at path.
+    // If the file holds this frame already, iterations and the rng state continue from it.
+    bool resume(const std::string& path, uint32_t& state) {
+        packed = true;
+        colorBuffer.clear({0, 0});
+        sampleCount = std::vector<int>();
+        prob = std::vector<float>();
         iterations = 0;
+
+        const bool resumed = checkpoint.open(path, {width, height}, hash(), camera.frameCount);
+        if (!checkpoint.isOpen()) {
+            accum = AccumBuffer({width, height}); // keep rendering in memory
+            if (!variance.empty()) variance.assign(size_t(width) * height, PixelVariance());
+            buildTiles();
+            return false;
+        }
+        accum = AccumBuffer({width, height}, checkpoint.pixels());
+        iterations = resumed ? checkpoint.header().iteration : 0;
+        if (resumed) state = checkpoint.resumedState();
+        // the variance and guides aren't checkpointed, resumed pixels collect them again
+        if (!variance.empty()) variance.assign(size_t(width) * height, PixelVariance());
+        if (!guides.empty()) guides.reset(size_t(width) * height);
+        buildTiles();
+        return resumed;
+    }
+    // Call after every completed iteration
+    void saveCheckpoint(const uint32_t state, const bool flush) {
+        if (checkpoint.isOpen()) checkpoint.commit(iterations, state, flush);
     }
 };
 
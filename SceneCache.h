@@ -0,0 +1,75 @@
+//
+// Created by Andreas Royset on 10/18/26.
+//
+
+#ifndef SCENECACHE_H
+#define SCENECACHE_H
+
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include "CompiledScene.h"
+#include "SceneParser.h"
+#include "Scene.h"
+
+// Scenes a daemon has loaded, keyed by path. An entry is loaded again once its file
+// changes, otherwise jobs share the parsed or mapped scene, its BVH and its pixel buffers.
+class SceneCache {
+    struct Entry {
+        std::filesystem::file_time_type modified;
+        std::unique_ptr<SceneParser> parser;
+        std::unique_ptr<CompiledScene> compiled; // has to outlive scene
+        RenderSettings settings;
+        std::unique_ptr<Scene> scene;
+        std::unique_ptr<Camera> camera; // as the scene file sets it up, before any frame
+    };
+    std::unordered_map<std::string, Entry> entries;
+
+    public:
+    struct Lookup {
+        Scene* scene = nullptr;
+        const RenderSettings* settings = nullptr;
+        const Camera* camera = nullptr;
+        bool loaded = false; // false if it came from the cache
+    };
+
+    // scene is nullptr if the file can't be read, errors go to std::cerr
+    Lookup get(const std::string& path, const bool packed) {
+        std::error_code error;
+        const auto modified = std::filesystem::last_write_time(path, error);
+        if (error) {
+            std::cerr << "Failed to open scene " << path << std::endl;
+            return {};
+        }
+        const auto it = entries.find(path);
+        if (it != entries.end() and it->second.modified == modified) {
+            return {it->second.scene.get(), &it->second.settings, it->second.camera.get(), false};
+        }
+        if (it != entries.end()) entries.erase(it);
+
+        Entry entry;
+        entry.modified = modified;
+        if (CompiledScene::isCompiled(path)) {
+            entry.compiled = std::make_unique<CompiledScene>();
+            if (!entry.compiled->open(path)) return {};
+            entry.settings = entry.compiled->settings();
+            entry.scene = std::make_unique<Scene>(entry.compiled->makeScene());
+        } else {
+            entry.parser = std::make_unique<SceneParser>();
+            if (!entry.parser->parseFile(path)) return {};
+            entry.settings = entry.parser->settings;
+            entry.scene = std::make_unique<Scene>(entry.parser->makeScene());
+        }
+        entry.scene->setPacked(packed);
+        entry.camera = std::make_unique<Camera>(entry.scene->camera);
+        Entry& stored = entries[path] = std::move(entry);
+        return {stored.scene.get(), &stored.settings, stored.camera.get(), true};
+    }
+
+    [[nodiscard]] size_t size() const {
+        return entries.size();
+    }
+};
+
+#endif //SCENECACHE_H
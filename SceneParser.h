@@ -0,0 +1,510 @@
+//
+// Created by Andreas Royset on 10/18/26.
+//
+
+#ifndef SCENEPARSER_H
+#define SCENEPARSER_H
+
+#include <cctype>
+#include <cstdint>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "Box.h"
+#include "Bvh.h"
+#include "Camera.h"
+#include "Floor.h"
+#include "Material.h"
+#include "Scene.h"
+#include "Sky.h"
+#include "Sphere.h"
+#include "float3.h"
+
+// Everything a scene file sets besides the scene contents
+struct RenderSettings {
+    int width = 0; // 0 derives the width from height and aspect
+    int height = 1440;
+    float aspect = 16.0f / 9.0f;
+    int antialiasing = 4;
+    int bounces = 15;
+    int tileSize = 128;
+    int iterations = 100;
+    bool bloom = true;
+    float falloff = 1.0f;
+    float adaptive = 0; // relative error at which a pixel stops sampling, 0 samples every pixel every iteration
+    SamplerType sampler = SamplerType::Sobol;
+    int denoise = 0; // a-trous passes over the averaged frame, 0 leaves it as rendered
+    float time = 0; // seconds a frame may take, 0 renders every iteration
+    float noise = 0; // estimated relative error at which a frame stops, 0 renders every iteration
+    float temporal = 0; // share of its samples an animation frame hands on to the next, 0 starts every frame cold
+    int roulette = 6; // first bounce Russian roulette can end a path at
+    float survival = 1; // summed rgb throughput from which a path always survives the roulette
+    int splits = 1; // paths continued from every camera ray's first hit
+
+    // What the parser would have rejected, for settings read from elsewhere. nullptr if they're fine.
+    [[nodiscard]] const char* invalid() const {
+        if (width < 0) return "negative width";
+        if (height <= 0) return "height below 1";
+        if (width == 0 and !(aspect > 0 and int(float(height) * aspect) > 0)) return "no pixels across";
+        if (antialiasing <= 0) return "antialiasing below 1";
+        if (bounces <= 0) return "bounces below 1";
+        if (tileSize <= 0) return "tile below 1";
+        if (iterations <= 0) return "iterations below 1";
+        if (!(survival > 0)) return "survival not above 0";
+        return nullptr;
+    }
+};
+
+// Where the camera is and how it moves, without the keys
+struct CameraPath {
+    float3 position = {0, 0, -800};
+    float3 target = {0, 0, 0};
+    int32_t animated = 0, duration = 1, frameRate = 1;
+    int32_t orbit = 0;
+    float3 orbitCenter, orbitTarget;
+    float orbitRadius = 0, orbitPeriod = 1;
+};
+struct CameraKey {
+    float time;
+    float3 position, target;
+};
+
+// Orbits, or interpolates keys linearly, or holds still if the path isn't animated
+inline Camera makeCamera(const CameraPath& path, const std::vector<CameraKey>& keys) {
+    if (!path.animated) return {path.position, path.target};
+    if (path.orbit) {
+        const float3 center = path.orbitCenter, target = path.orbitTarget;
+        const float radius = path.orbitRadius, period = path.orbitPeriod;
+        return {[=](const float t) {
+            const float angle = 2.0f * float(M_PI) * t / period;
+            return std::vector<float3>{center + float3(std::cos(angle), 0, std::sin(angle)) * radius, target};
+        }, path.duration, path.frameRate};
+    }
+    if (!keys.empty()) {
+        return {[keys](const float t) {
+            size_t next = 0;
+            while (next < keys.size() and keys[next].time <= t) next++;
+            if (next == 0) return std::vector<float3>{keys.front().position, keys.front().target};
+            if (next == keys.size()) return std::vector<float3>{keys.back().position, keys.back().target};
+            const CameraKey& a = keys[next - 1];
+            const CameraKey& b = keys[next];
+            const float f = (t - a.time) / (b.time - a.time);
+            return std::vector<float3>{a.position.lerp(b.position, f), a.target.lerp(b.target, f)};
+        }, path.duration, path.frameRate};
+    }
+    const float3 position = path.position, target = path.target;
+    return {[=](float) { return std::vector<float3>{position, target}; }, path.duration, path.frameRate};
+}
+
+// Puts every object that can be flattened behind one BvhGeometry, the others stay as they are.
+// geometry owns the BVH, the objects stay whoever's they were.
+inline std::vector<Object*> accelerate(const std::vector<Object*>& bodies, std::unique_ptr<BvhGeometry>& geometry) {
+    std::vector<Object*> rest;
+    geometry = std::make_unique<BvhGeometry>(bodies, rest);
+    rest.insert(rest.begin(), geometry.get());
+    return rest;
+}
+
+inline Scene makeScene(const RenderSettings& settings, const Camera& camera, const std::vector<Object*>& bodies, Floor* floor, Sky* sky) {
+    Scene scene = settings.width > 0 ?
+        Scene(settings.width, settings.height, camera, settings.antialiasing,
+            bodies, floor, sky, settings.bounces, settings.tileSize) :
+        Scene(settings.height, settings.aspect, camera, settings.antialiasing,
+            bodies, floor, sky, settings.bounces, settings.tileSize);
+    scene.setAdaptive(settings.adaptive);
+    scene.samplerType = settings.sampler;
+    scene.setGuided(settings.denoise > 0 or settings.temporal > 0);
+    if (settings.noise > 0) scene.trackVariance();
+    scene.paths = {settings.roulette, settings.survival, settings.splits};
+    return scene;
+}
+
+// Reads the text scene format in a single pass over the file. One statement per line, a
+// keyword followed by key=value pairs, # starts a comment. Vectors are x,y,z or a single
+// number for all three. Materials have to be defined before they are used.
+//
+//   settings height=1440 aspect=1.7778 antialiasing=4 bounces=8 tile=128 iterations=100 bloom=1 falloff=1 adaptive=0.02
+//            sampler=sobol (or random, stratified, bluenoise) denoise=5 time=60 noise=0.01 temporal=0.5
+//            roulette=6 survival=1 splits=1
+//   material red color=0.9,0.2,0.2 smoothness=0 specular=1 specular_color=0.9,0.2,0.2
+//            transparency=0 ior=1 emission=0
+//   sphere radius=150 position=700,-350,150 material=red
+//   box min=-10,-10,-10 max=10,10,10 material=red
+//   floor active=1 height=-500 material=red material2=red checker=100
+//   sky active=1 sun=0.4,0.4,0.9 sun_color=5,4.75,4.5 color1=0.6,0.75,0.9 color2=0.3,0.55,0.8
+//   camera position=400,-200,-800 target=0,0,0
+//   animation duration=10 fps=30
+//   orbit center=200,-300,0 radius=800 period=20 target=300,-350,-200
+//   key time=0 position=0,0,-800 target=0,0,0
+//
+// animation turns on the camera path, given either as an orbit or as keys that are linearly
+// interpolated. Without a path the camera stays where camera put it.
+class SceneParser {
+    std::string name;
+    const char* cursor = nullptr;
+    const char* end = nullptr;
+    int line = 1;
+    bool failed = false;
+
+    // everything the scenes point to lives as long as the parser
+    std::vector<std::unique_ptr<Material>> ownedMaterials;
+    std::vector<std::unique_ptr<Object>> ownedBodies;
+    mutable std::vector<std::unique_ptr<BvhGeometry>> geometries;
+    std::unordered_map<std::string, Material*> materials;
+
+    Material* own(std::unique_ptr<Material> material) {
+        ownedMaterials.push_back(std::move(material));
+        return ownedMaterials.back().get();
+    }
+    void addBody(std::unique_ptr<Object> body) {
+        bodies.push_back(body.get());
+        ownedBodies.push_back(std::move(body));
+    }
+
+    public:
+    RenderSettings settings;
+    std::vector<Object*> bodies;
+    std::unique_ptr<Floor> floor = std::make_unique<Floor>(true, -500, own(std::make_unique<Material>()));
+    std::unique_ptr<Sky> sky = std::make_unique<Sky>();
+    CameraPath camera;
+    std::vector<CameraKey> keys;
+
+    // Parses a whole file, errors go to std::cerr with their line number
+    bool parseFile(const std::string& path) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+            std::cerr << "Failed to open scene " << path << std::endl;
+            return false;
+        }
+        std::ostringstream contents;
+        contents << file.rdbuf();
+        return parse(contents.str(), path);
+    }
+
+    // text has to stay alive while parsing, names are only used for error messages
+    bool parse(const std::string& text, const std::string& sourceName = "scene") {
+        name = sourceName;
+        cursor = text.c_str();
+        end = cursor + text.size();
+        line = 1;
+        failed = false;
+
+        while (!failed and cursor < end) {
+            skipSpaces();
+            if (atLineEnd()) {
+                nextLine();
+                continue;
+            }
+            const std::string_view keyword = word();
+            if (keyword == "settings") parseSettings();
+            else if (keyword == "material") parseMaterial();
+            else if (keyword == "sphere") parseSphere();
+            else if (keyword == "box") parseBox();
+            else if (keyword == "floor") parseFloor();
+            else if (keyword == "sky") parseSky();
+            else if (keyword == "camera") parseCamera();
+            else if (keyword == "animation") parseAnimation();
+            else if (keyword == "orbit") parseOrbit();
+            else if (keyword == "key") parseKey();
+            else error("unknown statement '" + std::string(keyword) + "'");
+
+            if (!failed) {
+                skipSpaces();
+                if (!atLineEnd()) error("unexpected '" + std::string(word()) + "'");
+                nextLine();
+            }
+        }
+        if (!failed and !keys.empty() and camera.orbit) error("a camera path is either an orbit or keys");
+        return !failed;
+    }
+
+    // The BVH is built here, every call builds a new one
+    [[nodiscard]] Scene makeScene() const {
+        std::unique_ptr<BvhGeometry> geometry;
+        const std::vector<Object*> accelerated = accelerate(bodies, geometry);
+        geometries.push_back(std::move(geometry));
+        return ::makeScene(settings, makeCamera(camera, keys), accelerated, floor.get(), sky.get());
+    }
+
+    private:
+    void error(const std::string& message) {
+        if (!failed) std::cerr << name << ":" << line << ": " << message << std::endl;
+        failed = true;
+    }
+
+    void skipSpaces() {
+        while (cursor < end and (*cursor == ' ' or *cursor == '\t' or *cursor == '\r')) cursor++;
+    }
+    [[nodiscard]] bool atLineEnd() const {
+        return cursor >= end or *cursor == '\n' or *cursor == '#';
+    }
+    void nextLine() {
+        while (cursor < end and *cursor != '\n') cursor++;
+        if (cursor < end) {
+            cursor++;
+            line++;
+        }
+    }
+    std::string_view word() {
+        const char* start = cursor;
+        while (cursor < end and *cursor != ' ' and *cursor != '\t' and *cursor != '\r' and *cursor != '\n' and *cursor != '=' and *cursor != '#') cursor++;
+        return {start, size_t(cursor - start)};
+    }
+
+    // Calls field(key) for every key=value on the line, with the cursor on the value
+    template <typename F>
+    void fields(F&& field) {
+        while (!failed) {
+            skipSpaces();
+            if (atLineEnd()) return;
+            const std::string_view key = word();
+            if (cursor >= end or *cursor != '=') {
+                error("expected key=value, got '" + std::string(key) + "'");
+                return;
+            }
+            cursor++;
+            if (!field(key)) error("unknown key '" + std::string(key) + "'");
+        }
+    }
+
+    float number() {
+        // strtof would skip a newline, so the value has to start right here
+        if (cursor >= end or std::isspace((unsigned char)*cursor)) {
+            error("expected a number");
+            return 0;
+        }
+        char* after;
+        const float value = std::strtof(cursor, &after);
+        if (after == cursor) {
+            error("expected a number");
+            return 0;
+        }
+        cursor = after;
+        return value;
+    }
+    int integer() {
+        const float value = number();
+        if (value != std::floor(value)) error("expected a whole number");
+        return int(value);
+    }
+    // Counts the renderer divides by or loops over, nothing below 1 makes sense for them
+    int positive(const std::string_view key) {
+        const int value = integer();
+        if (value <= 0) error(std::string(key) + " has to be above 0");
+        return value;
+    }
+    bool boolean() {
+        const std::string_view value = word();
+        if (value == "1" or value == "true") return true;
+        if (value == "0" or value == "false") return false;
+        error("expected 0, 1, true or false");
+        return false;
+    }
+    float3 vector() {
+        const float x = number();
+        if (cursor >= end or *cursor != ',') return float3(x);
+        cursor++;
+        const float y = number();
+        if (cursor >= end or *cursor != ',') {
+            error("expected x,y,z");
+            return {};
+        }
+        cursor++;
+        return {x, y, number()};
+    }
+    Material* material() {
+        const std::string_view materialName = word();
+        const auto it = materials.find(std::string(materialName));
+        if (it != materials.end()) return it->second;
+        error("unknown material '" + std::string(materialName) + "'");
+        return nullptr;
+    }
+
+    SamplerType samplerType() {
+        const std::string_view name = word();
+        if (name == "random") return SamplerType::Random;
+        if (name == "sobol") return SamplerType::Sobol;
+        if (name == "stratified") return SamplerType::Stratified;
+        if (name == "bluenoise") return SamplerType::BlueNoise;
+        error("unknown sampler '" + std::string(name) + "'");
+        return SamplerType::Sobol;
+    }
+
+    void parseSettings() {
+        fields([&](const std::string_view key) {
+            if (key == "width") {
+                settings.width = integer();
+                if (settings.width < 0) error("width has to be 0 or above");
+            }
+            else if (key == "height") settings.height = positive(key);
+            else if (key == "aspect") {
+                settings.aspect = number();
+                if (settings.aspect <= 0) error("aspect has to be above 0");
+            }
+            else if (key == "antialiasing") settings.antialiasing = positive(key);
+            else if (key == "bounces") settings.bounces = positive(key);
+            else if (key == "tile") settings.tileSize = positive(key);
+            else if (key == "iterations") settings.iterations = positive(key);
+            else if (key == "bloom") settings.bloom = boolean();
+            else if (key == "falloff") settings.falloff = number();
+            else if (key == "adaptive") settings.adaptive = number();
+            else if (key == "sampler") settings.sampler = samplerType();
+            else if (key == "denoise") settings.denoise = integer();
+            else if (key == "time") settings.time = number();
+            else if (key == "noise") settings.noise = number();
+            else if (key == "temporal") settings.temporal = number();
+            else if (key == "roulette") settings.roulette = integer();
+            else if (key == "survival") {
+                settings.survival = number();
+                if (settings.survival <= 0) error("survival has to be above 0");
+            }
+            else if (key == "splits") settings.splits = integer();
+            else return false;
+            return true;
+        });
+    }
+
+    void parseMaterial() {
+        skipSpaces();
+        const std::string materialName(word());
+        if (materialName.empty()) {
+            error("material needs a name");
+            return;
+        }
+        // same defaults as the Material constructor
+        float3 color, emission;
+        float smoothness = 0, specular = 1, transparency = 0, ior = 1;
+        float3 specularColor(-1);
+        fields([&](const std::string_view key) {
+            if (key == "color") color = vector();
+            else if (key == "smoothness") smoothness = number();
+            else if (key == "specular") specular = number();
+            else if (key == "specular_color") specularColor = vector();
+            else if (key == "transparency") transparency = number();
+            else if (key == "ior") ior = number();
+            else if (key == "emission") emission = vector();
+            else return false;
+            return true;
+        });
+        materials[materialName] = own(std::make_unique<Material>(color, smoothness, specular, specularColor, transparency, ior, emission));
+    }
+
+    void parseSphere() {
+        float radius = 1;
+        float3 position;
+        Material* sphereMaterial = nullptr;
+        fields([&](const std::string_view key) {
+            if (key == "radius") radius = number();
+            else if (key == "position") position = vector();
+            else if (key == "material") sphereMaterial = material();
+            else return false;
+            return true;
+        });
+        if (!failed and sphereMaterial == nullptr) error("sphere needs a material");
+        if (!failed) addBody(std::make_unique<Sphere>(radius, position, sphereMaterial));
+    }
+
+    void parseBox() {
+        float3 minCorner, maxCorner;
+        Material* boxMaterial = nullptr;
+        fields([&](const std::string_view key) {
+            if (key == "min") minCorner = vector();
+            else if (key == "max") maxCorner = vector();
+            else if (key == "material") boxMaterial = material();
+            else return false;
+            return true;
+        });
+        if (!failed and boxMaterial == nullptr) error("box needs a material");
+        if (!failed) addBody(std::make_unique<Box>(minCorner, maxCorner, boxMaterial));
+    }
+
+    void parseFloor() {
+        bool active = true;
+        float height = -500, checker = 1000;
+        Material* material1 = nullptr;
+        Material* material2 = nullptr;
+        fields([&](const std::string_view key) {
+            if (key == "active") active = boolean();
+            else if (key == "height") height = number();
+            else if (key == "material") material1 = material();
+            else if (key == "material2") material2 = material();
+            else if (key == "checker") checker = number();
+            else return false;
+            return true;
+        });
+        if (failed) return;
+        if (material1 == nullptr) material1 = own(std::make_unique<Material>());
+        floor = std::make_unique<Floor>(active, height, material1, material2, checker);
+    }
+
+    void parseSky() {
+        Sky defaults;
+        bool active = true;
+        float3 sun = defaults.sun_dir, sunColor = defaults.sun_color;
+        float3 color1 = defaults.color1, color2 = defaults.color2;
+        fields([&](const std::string_view key) {
+            if (key == "active") active = boolean();
+            else if (key == "sun") sun = vector();
+            else if (key == "sun_color") sunColor = vector();
+            else if (key == "color1") color1 = vector();
+            else if (key == "color2") color2 = vector();
+            else return false;
+            return true;
+        });
+        if (!failed) sky = std::make_unique<Sky>(active, sun.normalize(), sunColor, color1, color2);
+    }
+
+    void parseCamera() {
+        fields([&](const std::string_view key) {
+            if (key == "position") camera.position = vector();
+            else if (key == "target") camera.target = vector();
+            else return false;
+            return true;
+        });
+    }
+
+    void parseAnimation() {
+        camera.animated = 1;
+        fields([&](const std::string_view key) {
+            if (key == "duration") camera.duration = integer();
+            else if (key == "fps") camera.frameRate = integer();
+            else return false;
+            return true;
+        });
+        if (!failed and camera.frameRate < 2) error("animations need fps of at least 2, fps=1 renders a still");
+    }
+
+    void parseOrbit() {
+        camera.orbit = 1;
+        fields([&](const std::string_view key) {
+            if (key == "center") camera.orbitCenter = vector();
+            else if (key == "radius") camera.orbitRadius = number();
+            else if (key == "period") camera.orbitPeriod = number();
+            else if (key == "target") camera.orbitTarget = vector();
+            else return false;
+            return true;
+        });
+    }
+
+    void parseKey() {
+        CameraKey key{float(keys.size()), camera.position, camera.target};
+        fields([&](const std::string_view field) {
+            if (field == "time") key.time = number();
+            else if (field == "position") key.position = vector();
+            else if (field == "target") key.target = vector();
+            else return false;
+            return true;
+        });
+        if (!failed and !keys.empty() and key.time <= keys.back().time) error("key times have to increase");
+        keys.push_back(key);
+    }
+};
+
+#endif //SCENEPARSER_H
@@ -5,12 +5,16 @@
 #ifndef SKY_H
 #define SKY_H
 
+#include "Hash.h"
+#include "Sampling.h"
+
 inline int clamp(const int x, const int min, const int max) {
     return std::max(min, std::min(max, x));
 }
 
 class Sky {
     public:
+    static constexpr int sunExponent = 1024;
     bool active;
     float3 color1;
     float3 color2;
@@ -57,13 +61,33 @@ class Sky {
 
             //return ev_color;
         }
-        float3 ev_color = this->color1.lerp(this->color2, abs(dir.y));
-
-        const float sun_strength = float(pow(std::max(0.0f, dir.dot(this->sun_dir)), 1024)); // sharp sun disc
-        ev_color += this->sun_color * sun_strength;
+        float3 ev_color = getBackground(dir);
+        ev_color += getSun(dir);
 
         return ev_color;
     }
+    [[nodiscard]] float3 getBackground(const float3& dir) const {
+        return this->color1.lerp(this->color2, abs(dir.y));
+    }
+    [[nodiscard]] float3 getSun(const float3& dir) const {
+        const float sun_strength = float(pow(std::max(0.0f, dir.dot(this->sun_dir)), sunExponent)); // sharp sun disc
+        return this->sun_color * sun_strength;
+    }
+
+    [[nodiscard]] bool hasSun() const {
+        return active and sun_color.mag() > 0;
+    }
+    // Directions drawn in proportion to the sun's falloff, so sampling it is exact
+    [[nodiscard]] float3 sampleSun(const float u1, const float u2) const {
+        return sampleCosinePower(Onb(sun_dir), sunExponent, u1, u2).normalize();
+    }
+    [[nodiscard]] float sunPdf(const float3& dir) const {
+        return cosinePowerPdf(dir.dot(sun_dir), sunExponent);
+    }
+
+    void hash(Hasher& hasher) const {
+        hasher.add(active).add(color1).add(color2).add(sun_dir).add(sun_color);
+    }
 };
 
 #endif //SKY_H
@@ -32,36 +32,58 @@ class Sphere : public Object {
             return hit_info;
         }
 
-    [[nodiscard]] HitInfo* checkCollision(const float3& pos, const float3& dir, const float3& inv_dir) const override {
-        const float3 ray_pos = pos-this->pos;
+    void hash(Hasher& hasher) const override {
+        hasher.add(std::string("sphere")).add(radius).add(pos);
+        material->hash(hasher);
+    }
+    bool flatten(Primitive& out, Material*& material) const override {
+        out.type = PrimitiveType::Sphere;
+        out.a = pos;
+        out.b = {radius, 0, 0};
+        material = this->material;
+        return true;
+    }
+
+    void lights(std::vector<SphereLight>& out) const override {
+        if (material->emission_color.mag() > 0) out.push_back({pos, radius, material});
+    }
+
+    // Nearest hit further than 0.01 along the ray, shared with the BVH
+    static bool intersect(const float3& center, const float radius, const float3& pos, const float3& dir, float& t, float3& normal) {
+        const float3 ray_pos = pos-center;
         const float d = ray_pos.dot(dir);
 
-        const auto discriminant = float(d*d - ray_pos.x*ray_pos.x - ray_pos.y*ray_pos.y - ray_pos.z*ray_pos.z + this->radius*this->radius);
+        const auto discriminant = float(d*d - ray_pos.x*ray_pos.x - ray_pos.y*ray_pos.y - ray_pos.z*ray_pos.z + radius*radius);
 
         if (discriminant < 0) {
-            return hit();
+            return false;
         } if (discriminant == 0) {
-            const float t = -d;
-            const float3 newPos = pos-dir*-t;
+            t = -d;
             if (t > 0.01) {
-                return hit(true, t, (newPos-this->pos).normalize());
+                normal = (pos-dir*-t-center).normalize();
+                return true;
             }
-            return hit(false);
+            return false;
         }
-        float t = -d - float(sqrt(discriminant));
+        t = -d - float(sqrt(discriminant));
         if (t > 0.01) {
-            const float3 newPos = pos-dir*-t;
-            return hit(true, t, (newPos-this->pos).normalize());
+            normal = (pos-dir*-t-center).normalize();
+            return true;
         }
         t = -d + float(sqrt(discriminant));
         if (t > 0.01) {
-            const float3 newPos = pos-dir*-t;
-            return hit(true, t, (newPos-this->pos).normalize());
+            normal = (pos-dir*-t-center).normalize();
+            return true;
         }
-            return hit();
+        return false;
     }
 
-
+    [[nodiscard]] HitInfo* checkCollision(const float3& pos, const float3& dir, const float3& inv_dir) const override {
+        float t;
+        float3 normal;
+        if (intersect(this->pos, radius, pos, dir, t, normal)) return hit(true, t, normal);
+        return hit();
+    }
 };
 
 #endif //SPHERE_H
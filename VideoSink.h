@@ -0,0 +1,128 @@
+//
+// Created by Andreas Royset on 10/18/26.
+//
+
+#ifndef VIDEOSINK_H
+#define VIDEOSINK_H
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "int2.h"
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#define PIPE_WRITE_MODE "wb"
+#else
+#define PIPE_WRITE_MODE "w"
+#include <csignal>
+#endif
+
+enum class VideoFormat { RawRgb, Y4m };
+
+// Pipes finished frames straight into an encoder's stdin, no intermediate files.
+class VideoSink {
+    FILE* pipe = nullptr;
+    int2 size;
+    VideoFormat format;
+    int frameRate;
+    int frames = 0;
+    std::vector<unsigned char> yuv;
+
+    public:
+    // command reads frames from stdin, see ffmpegCommand
+    VideoSink(const std::string& command, const int2 size, const int frameRate, const VideoFormat format = VideoFormat::Y4m) {
+        this->size = size;
+        this->frameRate = frameRate;
+        this->format = format;
+#ifndef _WIN32
+        std::signal(SIGPIPE, SIG_IGN); // a dead encoder should fail the write, not kill the render
+#endif
+        pipe = popen(command.c_str(), PIPE_WRITE_MODE);
+        if (pipe == nullptr) {
+            std::cerr << "Failed to start encoder: " << command << std::endl;
+        }
+    }
+    VideoSink(const VideoSink&) = delete;
+    VideoSink& operator=(const VideoSink&) = delete;
+    ~VideoSink() {
+        close();
+    }
+
+    static std::string ffmpegCommand(const std::string& output, const int2 size, const int frameRate, const VideoFormat format = VideoFormat::Y4m) {
+        std::string command = "ffmpeg -loglevel quiet -y ";
+        if (format == VideoFormat::RawRgb) {
+            command += "-f rawvideo -pix_fmt rgb24 -s " + std::to_string(size.x) + 'x' + std::to_string(size.y);
+            command += " -framerate " + std::to_string(frameRate);
+        } else {
+            command += "-f yuv4mpegpipe";
+        }
+        command += " -i - -c:v libx264 -pix_fmt yuv420p " + output;
+        return command;
+    }
+
+    // rgb is size.x * size.y * 3 bytes, top row first
+    bool write(const std::vector<unsigned char>& rgb) {
+        if (pipe == nullptr) return false;
+
+        if (format == VideoFormat::RawRgb) {
+            if (fwrite(rgb.data(), 1, rgb.size(), pipe) != rgb.size()) return fail();
+            frames++;
+            return true;
+        }
+
+        if (frames == 0) {
+            const std::string header = "YUV4MPEG2 W" + std::to_string(size.x) + " H" + std::to_string(size.y) +
+                " F" + std::to_string(frameRate) + ":1 Ip A1:1 C444 XCOLORRANGE=LIMITED\n";
+            if (fwrite(header.data(), 1, header.size(), pipe) != header.size()) return fail();
+        }
+        toYuv(rgb);
+        constexpr char frameHeader[] = "FRAME\n";
+        if (fwrite(frameHeader, 1, sizeof(frameHeader) - 1, pipe) != sizeof(frameHeader) - 1) return fail();
+        if (fwrite(yuv.data(), 1, yuv.size(), pipe) != yuv.size()) return fail();
+        frames++;
+        return true;
+    }
+
+    // Waits for the encoder to finish, returns its exit status
+    int close() {
+        if (pipe == nullptr) return -1;
+        const int result = pclose(pipe);
+        pipe = nullptr;
+        if (result != 0) {
+            std::cerr << "Encoder failed with code: " << result << std::endl;
+        } else {
+            std::cout << "Video created successfully (" << frames << " frames).\n";
+        }
+        return result;
+    }
+
+    private:
+    bool fail() {
+        std::cerr << "Encoder stopped accepting frames after frame " << frames << std::endl;
+        pclose(pipe);
+        pipe = nullptr;
+        return false;
+    }
+
+    // BT.709 limited range, planar 4:4:4
+    void toYuv(const std::vector<unsigned char>& rgb) {
+        const size_t count = size_t(size.x) * size.y;
+        yuv.resize(count * 3);
+        unsigned char* y = yuv.data();
+        unsigned char* u = y + count;
+        unsigned char* v = u + count;
+        for (size_t i = 0; i < count; i++) {
+            const float r = rgb[i*3];
+            const float g = rgb[i*3+1];
+            const float b = rgb[i*3+2];
+            y[i] = (unsigned char)(16.5f + 0.1826f * r + 0.6142f * g + 0.0620f * b);
+            u[i] = (unsigned char)(128.5f - 0.1006f * r - 0.3386f * g + 0.4392f * b);
+            v[i] = (unsigned char)(128.5f + 0.4392f * r - 0.3989f * g - 0.0403f * b);
+        }
+    }
+};
+
+#endif //VIDEOSINK_H
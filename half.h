@@ -0,0 +1,60 @@
+//
+// Created by Andreas Royset on 10/18/26.
+//
+
+#ifndef HALF_H
+#define HALF_H
+
+#include <cstdint>
+#include <cstring>
+
+// IEEE 754 binary16 conversions, round to nearest even.
+// Based on Fabian Giesen's float_to_half_fast3_rtne / half_to_float_fast5.
+inline uint16_t floatToHalf(const float value) {
+    uint32_t f;
+    std::memcpy(&f, &value, sizeof(f));
+    const uint32_t sign = f & 0x80000000u;
+    f ^= sign;
+
+    uint16_t out;
+    if (f >= 0x47800000u) { // too big for half: inf, or nan
+        out = f > 0x7F800000u ? 0x7E00 : 0x7C00;
+    } else if (f < 0x38800000u) { // subnormal or zero, let the fpu do the rounding
+        float denorm;
+        std::memcpy(&denorm, &f, sizeof(denorm));
+        denorm += 0.5f;
+        uint32_t bits;
+        std::memcpy(&bits, &denorm, sizeof(bits));
+        out = uint16_t(bits - 0x3F000000u);
+    } else {
+        const uint32_t mantissaOdd = (f >> 13) & 1;
+        f += (uint32_t(15 - 127) << 23) + 0xFFF;
+        f += mantissaOdd;
+        out = uint16_t(f >> 13);
+    }
+    return out | uint16_t(sign >> 16);
+}
+
+inline float halfToFloat(const uint16_t value) {
+    constexpr uint32_t shiftedExponent = 0x7C00u << 13;
+    uint32_t bits = (value & 0x7FFFu) << 13;
+    const uint32_t exponent = bits & shiftedExponent;
+    bits += uint32_t(127 - 15) << 23;
+
+    if (exponent == shiftedExponent) { // inf or nan
+        bits += uint32_t(128 - 16) << 23;
+    } else if (exponent == 0) { // zero or subnormal, renormalize
+        bits += 1u << 23;
+        float f;
+        std::memcpy(&f, &bits, sizeof(f));
+        f -= 6.10351562e-05f; // 2^-14
+        std::memcpy(&bits, &f, sizeof(bits));
+    }
+    bits |= uint32_t(value & 0x8000u) << 16;
+
+    float out;
+    std::memcpy(&out, &bits, sizeof(out));
+    return out;
+}
+
+#endif //HALF_H
@@ -12,11 +12,26 @@
 #include "Floor.h"
 #include "Scene.h"
 #include "Sky.h"
+#include "Resolve.h"
+#include "PostBuffer.h"
+#include "VideoSink.h"
+#include "ImageWriter.h"
+#include "HdrWriter.h"
+#include "FrameManifest.h"
+#include "SceneParser.h"
+#include "CompiledScene.h"
+#include "JobSpool.h"
+#include "SceneCache.h"
+#include "Denoiser.h"
+#include "RenderBudget.h"
+#include "FrameHistory.h"
 #include <valarray>
 #include "int2.h"
 #include <functional>
 #include <mutex>
 #include <chrono>
+#include <filesystem>
+#include <memory>
 
 namespace fs = std::filesystem;
 
@@ -139,8 +154,8 @@ public:
 
 };
 
-inline void makeImage(const char* filename, const std::vector<float>& data, int2 size) {
-    auto* newData = new unsigned char[size.x * size.y * 3];
+inline void makeImage(const std::string& filename, const std::vector<float>& data, int2 size, const ImageFormat format = ImageFormat::Png) {
+    std::vector<unsigned char> newData(size.x * size.y * 3);
     for (int x = 0; x < size.x; x++) {
         for (int y = 0; y < size.y; y++) {
             const int index = x + y * size.x;
@@ -152,77 +167,53 @@ inline void makeImage(const char* filename, const std::vector<float>& data, int2
             newData[3*index+2] = int(color);
         }
     }
-    stbi_write_png(filename, size.x, size.y, 3, newData, size.x * 3);
-    delete[] newData;
+    saveImage(filename, newData, size, format);
 }
 float3 makeRay(const float2& pos, const Scene& scene) {
-    // Build camera basis
-
-    // Screen space
-    const float ndc_x = (pos.x) / float(scene.width);  // 0 - 1
-    const float ndc_y = (pos.y) / float(scene.height);
-
-    float screen_x = 1.0f - 2.0f * ndc_x; //-1 - 1
-    float screen_y = 1.0f - 2.0f * ndc_y; // flip y //-1 - 1
-
-    const float aspect_ratio = float(scene.width)/float(scene.height);
-    constexpr float scale = 1.0f;//tanf((fov * 0.5f) * (float(M_PI) / 180.0f)); // fov to scale
-
-    screen_x *= aspect_ratio * scale;
-    screen_y *= scale;
-
-    // Ray direction
-    const float3 dir = (scene.camera.forward + scene.camera.right * screen_x + scene.camera.up * screen_y).normalize();
-
-    return dir;
+    return scene.camera.direction(Camera::toScreen(pos, scene.width, scene.height));
 }
-void renderTile(const int tileX, const int tileY, const int tileWidth, const int tileHeight, Scene& scene, uint32_t& state) {
+// Samples the tile's active pixels once, and drops the ones that stop from its list. The
+// sampler is the tile's own, seed only picks which of the deterministic sequences it draws.
+void renderTile(const int tileX, const int tileY, Scene& scene, const uint32_t seed) {
     const int aa = scene.antialiasing;
-    const int aaStep = scene.iterations%(aa*aa);
+    const std::unique_ptr<Sampler> sampler = makeSampler(scene.samplerType, scene.plannedSamples);
+    const uint32_t frameSeed = sampling::hash(seed, uint32_t(scene.camera.frameCount));
 
     Ray ray;
+    PathStats& stats = scene.tilePaths(tileX, tileY);
 
-    for (int y = tileY; y < tileY+tileHeight; ++y) {
-        for (int x = tileX; x < tileX+tileWidth; ++x) {
-            if (x >= scene.width || y >= scene.height) continue;
+    std::vector<int>& active = scene.activePixels(tileX, tileY);
+    size_t kept = 0;
+    for (const int index : active) {
+        const int x = index % scene.width;
+        const int y = index / scene.width;
 
-            const int index = y * scene.width + x;
+        //if ((x % scene.tileSize == 0) or (y % scene.tileSize == 0)) {
+        //    colorBuffer[i] += Vec3f(1, 0, 0);
+        //    sampleCount[i] += 1;
+        //    continue;
+        //}
 
-            //if ((x % scene.tileSize == 0) or (y % scene.tileSize == 0)) {
-            //    colorBuffer[i] += Vec3f(1, 0, 0);
-            //    sampleCount[i] += 1;
-            //    continue;
-            //}
+        sampler->start(x, y, scene.iterations, frameSeed);
+        const float2 offset = sampler->get2D(); // anywhere in the pixel
 
-            bool hitSky = false;
+        float3 dir = makeRay({float(x) + offset.x - 0.5f, float(y) + offset.y - 0.5f}, scene);
+        const std::pair<float3, bool> out = ray.trace(scene.camera.position, dir, scene.bodies, scene.floor_data, scene.sky_data, scene.lights, scene.bounceLim, scene.paths, *sampler, stats);
 
-            if (int(scene.prob[index])) {
-                const auto xi = float(aaStep % aa);
-                const auto yi = float(aaStep) / float(aa);
+        const float3 color = out.first*255;
+        const bool hitSky = out.second;
 
-                const float ox = (xi + 0.5f) / float(aa) - 0.5f; // Center of each subpixel grid cell
-                const float oy = (yi + 0.5f) / float(aa) - 0.5f;
+        scene.addSample(x, y, color);
+        scene.addGuide(index, ray.firstHit());
 
-                float3 dir = makeRay({float(x) + ox, float(y) + oy}, scene);
-                const std::pair<float3, bool> out = ray.trace(scene.camera.position, dir, scene.bodies, scene.floor_data, scene.sky_data, scene.bounceLim, state);
-
-                const float3 color = out.first*255;
-                const bool sky = out.second;
-
-                if (sky) {
-                    hitSky = true;
-                }
-
-                scene.colorBuffer.add(x,y,color);
-                scene.sampleCount[index]++;
-            }
-            if (hitSky) {
-                if (scene.iterations+1>=aa*aa) {
-                    scene.prob[index] = 0;
-                }
-            }
+        // antialiasing squared samples before a pixel that only sees sky can stop
+        if ((hitSky and scene.iterations+1>=aa*aa) or scene.converged(index)) {
+            scene.deactivate(index);
+            continue;
         }
+        active[kept++] = index;
     }
+    active.resize(kept);
 }
 std::string timeConversionnMS(int ms) {
     auto x = float(ms);
@@ -277,46 +268,61 @@ std::string timeConversionnMS(int ms) {
     out += "h";
     return out;
 }
-std::vector<float3> path(const float t) {
-    //float3 pos = {350, -300, -650};
-    float3 tgt = {300, -350, -200};
-
-    float3 pos = {800 * float(cos(t*M_PI/10))+200, -300, 800 * float(sin(t*M_PI/10))};
-
-    return {pos, tgt};
-}
-void makeMp4(const std::string& path, const int2 size) {
-    std::string command = "ffmpeg -loglevel quiet -y -framerate 30 -i ";
-    command += path;
-    command += "frame%03d.png -vf scale=";
-    command += std::to_string(size.x) + ':' + std::to_string(size.y) + ' ';
-    command += "-c:v libx264 -pix_fmt yuv420p output.mp4";
-
-    int result = std::system(command.c_str());
-
-    if (result != 0) {
-        std::cerr << "FFmpeg command failed with code: " << result << std::endl;
-    } else {
-        std::cout << "Video created successfully.\n";
-    }
-}
-void createFrame(const std::string& path, const Image& image, const int frameNum) {
+std::string frameName(const std::string& path, const int frameNum) {
     std::string filename = path + "frame";
     const int zeros = 3 - int(std::to_string(frameNum).length());
     for (int j = 0; j < zeros; ++j) filename += '0';
     filename += std::to_string(frameNum);
-    filename += ".png";
-    image.makePng(filename);
+    return filename;
+}
+void createFrame(const std::string& path, const std::vector<unsigned char>& pixels, const int2 size, const int frameNum, const ImageFormat format = ImageFormat::Png) {
+    saveImage(frameName(path, frameNum) + imageExtension(format), pixels, size, format);
+}
+// Averaged radiance as frameNNN.exr/.pfm and the raw sums with sample counts as frameNNN_accum.exr
+void createHdrFrame(const std::string& path, const Scene& scene, const HdrFormat format) {
+    const std::string filename = frameName(path, scene.camera.frameCount);
+    if (scene.packed) {
+        saveRadiance(filename + hdrExtension(format), scene.accum, format);
+        saveAccumulation(filename + "_accum.exr", scene.accum);
+    } else {
+        saveRadiance(filename + hdrExtension(format), scene.colorBuffer, scene.sampleCount, format);
+        saveAccumulation(filename + "_accum.exr", scene.colorBuffer, scene.sampleCount);
+    }
+}
+// Write throughput of each ImageFormat on a real frame, compared to the old makePng path
+void benchmarkWriters(const std::vector<unsigned char>& pixels, const int2 size) {
+    const double megabytes = double(pixels.size()) / (1024.0 * 1024.0);
+    const std::vector<std::pair<std::string, ImageFormat>> formats = {
+        {"png (stb)", ImageFormat::Png},
+        {"png fast", ImageFormat::PngFast},
+        {"png stored", ImageFormat::PngStored},
+        {"png parallel", ImageFormat::PngParallel},
+        {"qoi", ImageFormat::Qoi},
+    };
+    for (const auto& [name, format] : formats) {
+        const std::string filename = "benchmark" + imageExtension(format);
+        constexpr int runs = 5;
+        Timer timer;
+        for (int i = 0; i < runs; i++) saveImage(filename, pixels, size, format);
+        const double seconds = std::max(timer.elapsed(), 1) / 1000.0;
+        const auto bytes = fs::file_size(filename);
+        std::cout << name << ":  " << int(megabytes * runs / seconds) << " MB/s  -  " << bytes / 1024 << " KB" << std::endl;
+        fs::remove(filename);
+    }
 }
 Image readFrame(const std::string& path, const int frameNum) {
-    std::string filename = path + "frame";
-    const int zeros = 3 - int(std::to_string(frameNum).length());
-    for (int j = 0; j < zeros; ++j) filename += '0';
-    filename += std::to_string(frameNum);
-    filename += ".png";
-    Image image = Image(filename);
+    Image image = Image(frameName(path, frameNum) + ".png");
     return image;
 }
+// Pixels of a frame already on disk, empty if it can't be read or has the wrong size
+std::vector<unsigned char> loadFrame(const std::string& filename, const int2 size) {
+    int width, height, channels;
+    unsigned char* data = stbi_load(filename.c_str(), &width, &height, &channels, 3);
+    std::vector<unsigned char> pixels;
+    if (data != nullptr and width == size.x and height == size.y) pixels.assign(data, data + size_t(width) * height * 3);
+    stbi_image_free(data);
+    return pixels;
+}
 void deletePngs(const std::string& folderPath) {
     const std::string command = "rm -f " + folderPath + "/*.png";
     std::system(command.c_str());
@@ -329,244 +335,342 @@ float softThreshold(const float x, const float threshold) {
         return ((x - threshold) * (x - threshold)) / (2.0f * knee);
     return x - threshold - (knee / 2.0f);
 }
-void wait_with_progress(ThreadPool& pool, int interval_ms, int tasks) {
+// Thresholds the averaged frame and, with bloom on, blurs it over a mip chain and tonemaps
+// it back up to size
+void makeBloom(Image& bloom, const int2 size, const bool bloomActive, const float falloff, const Precision precision) {
+    bloom.parallelApply([](const float x){return softThreshold(x, 127.5f);});
+    bloom.clamp(0, 8192);
+    if (!bloomActive) return;
+    bloom.bloomDownsample();
+    const int numMipLevels = int(log2(float(bloom.getSize().y)))-1;
+
+    //downsample
+    std::vector<PostBuffer> mipLevels;
+    mipLevels.emplace_back(bloom, precision);
+    //bloom.makePng("downsample0.png");
+    for (int i = 0; i < numMipLevels-1; i++) {
+        bloom.bloomDownsample();
+        mipLevels.emplace_back(bloom, precision);
+        //bloom.makePng("downsample"+std::to_string(i+1)+".png");
+    }
+
+    //upsample
+    float weight = 1;
+    float total = 0;
+    bloom *= float3(weight); // apply weight to lowest mip before any += happens
+    weight *= falloff;
+    total += weight;
+    for (int i = 0; i < numMipLevels-1; i++) {
+        const PostBuffer& currentLevel = mipLevels[numMipLevels-i-2];
+        bloom.bloomUpsample(currentLevel.getSize());
+        currentLevel.addTo(bloom, 1 + weight);
+        weight *= falloff;
+        total += weight;
+        //bloom.makePng("upsample"+std::to_string(i+1)+".png");
+    }
+    bloom *= float3(1/total);
+
+    //tonemap
+    bloom *= float3(0.5f);
+    bloom.aces(TransferMode::Fast);
+    bloom.bloomUpsample(size);
+    bloom.clamp(0, 255);
+}
+// denoised is the filtered average, nullptr resolves the accumulated samples as they are
+std::vector<unsigned char> resolveFrame(const Scene& scene, const Image& bloom, const Image* denoised = nullptr) {
+    if (denoised != nullptr) return resolve<NoTonemap, unsigned char, TransferMode::Fast>(*denoised, &bloom);
+    return scene.packed ?
+        resolve<NoTonemap, unsigned char, TransferMode::Fast>(scene.accum, &bloom) :
+        resolve<NoTonemap, unsigned char, TransferMode::Fast>(scene.colorBuffer, scene.sampleCount, &bloom);
+}
+
+// Renders one still on the daemon's pool, waiting after every iteration so progress is exact
+bool renderJob(const RenderJob& job, SceneCache& cache, ThreadPool& pool, const JobSpool& spool, const uint32_t seed) {
     Timer timer;
-    int prevRem = tasks;
-    int remaining = tasks;
-    int avgRate = 0;
-    int samples = 0;
-    while (true) {
-        prevRem = remaining;
-        remaining = int(pool.tasks_left());
-        const int delta = prevRem - remaining;
-        avgRate *= samples;
-        avgRate += delta;
-        ++samples;
-        avgRate /= samples;
-        int t = timer.reset() / avgRate * remaining;
-        std::cout << "\rTasks remaining: " << remaining << "  -  " << timeConversionnMS(t) << " left" << std::flush;
-
-        if (remaining <= 0) break;
-        std::this_thread::sleep_for(std::chrono::milliseconds(interval_ms));
+    const SceneCache::Lookup found = cache.get(job.scene, false);
+    if (found.scene == nullptr) return false;
+    Scene& scene = *found.scene;
+    const RenderSettings& settings = *found.settings;
+    std::cout << job.name << ": " << (found.loaded ? "loaded " : "cached ") << job.scene << "  -  " << timeConversionnMS(timer.reset()) << std::endl;
+
+    scene.camera = job.hasCamera ? Camera(job.position, job.target) : *found.camera;
+    for (int frame = job.hasCamera ? 1 : job.frame; frame > 0; frame--) {
+        if (scene.camera.update()) {
+            std::cerr << job.name << ": frame " << job.frame << " is past the end of the animation" << std::endl;
+            return false;
+        }
     }
-    std::cout << "\nAll Tasks Finished" << std::endl;
+
+    const int samples = job.samples > 0 ? job.samples : settings.iterations;
+    scene.plannedSamples = samples;
+    scene.reset();
+    Timer renderTimer;
+    RenderBudget budget(samples, settings.time, settings.noise);
+    RenderBudget::Stop stop;
+    while ((stop = budget.check(scene)) == RenderBudget::Stop::Running) {
+        for (int tileY = 0; tileY < scene.height; tileY += scene.tileSize) {
+            for (int tileX = 0; tileX < scene.width; tileX += scene.tileSize) {
+                // every task owns its seed, nothing random is shared between the pool's threads.
+                // Iterations aren't hashed in, the sampler tells them apart by sample index.
+                const uint32_t tileSeed = sampling::hash(seed, uint32_t(tileY * scene.width + tileX));
+                pool.enqueue([&scene, tileX, tileY, tileSeed]() {
+                    renderTile(tileX, tileY, scene, tileSeed);
+                });
+            }
+        }
+        pool.wait_for_tasks();
+        scene.iterations ++;
+
+        const int elapsed = renderTimer.elapsed();
+        const std::string line = "iteration " + std::to_string(scene.iterations) + "/" + std::to_string(samples) +
+            "  -  " + std::to_string((100*scene.iterations)/samples) + "%  -  " +
+            timeConversionnMS(elapsed/scene.iterations*(samples-scene.iterations)) + " left";
+        spool.progress(job, line);
+        std::cout << "\r" << job.name << ": " << line << std::flush;
+    }
+    std::cout << std::endl;
+    std::cout << job.name << ": " << scene.iterations << " iterations, " << std::round(scene.meanSamples() * 10) / 10 <<
+        " samples per pixel  -  " << RenderBudget::describe(stop) << std::endl;
+
+    std::error_code error;
+    const fs::path output(job.output);
+    if (output.has_parent_path()) fs::create_directories(output.parent_path(), error);
+    const std::string extension = output.extension().string();
+    if (extension == ".exr" or extension == ".pfm") {
+        const HdrFormat format = extension == ".pfm" ? HdrFormat::Pfm : HdrFormat::ExrHalf;
+        if (scene.packed) return saveRadiance(job.output, scene.accum, format);
+        return saveRadiance(job.output, scene.colorBuffer, scene.sampleCount, format);
+    }
+    Image average = scene.averageImage();
+    const Denoiser denoiser(settings.denoise);
+    denoiser.apply(average, scene.guides);
+    Image bloom = average;
+    makeBloom(bloom, {scene.width, scene.height}, settings.bloom, settings.falloff, Precision::Float16);
+    fs::remove(output, error);
+    saveImage(job.output, resolveFrame(scene, bloom, settings.denoise > 0 ? &average : nullptr), {scene.width, scene.height}, extension == ".qoi" ? ImageFormat::Qoi : ImageFormat::PngParallel);
+    return fs::exists(output);
 }
 
-int main() {
+// Stays resident and renders the jobs dropped into spoolDir one after another, keeping the
+// threads and every scene it loaded for the next job
+int serve(const std::string& spoolDir) {
+    JobSpool spool(spoolDir);
+    if (!spool.isOpen()) {
+        std::cerr << "Failed to open spool directory " << spoolDir << std::endl;
+        return 1;
+    }
+    const int numThreads = std::max(1, int(std::thread::hardware_concurrency()));
+    ThreadPool pool(numThreads);
+    SceneCache cache;
+    const auto seed = uint32_t(time(nullptr));
+    constexpr int pollMS = 250;
+    std::cout << "Serving " << spoolDir << "  -  " << numThreads << " Threads" << std::endl;
+
+    int jobs = 0;
+    while (!spool.stopRequested()) {
+        RenderJob job;
+        if (!spool.next(job)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(pollMS));
+            continue;
+        }
+        Timer timer;
+        const bool ok = renderJob(job, cache, pool, spool, seed);
+        spool.finish(job, ok);
+        jobs++;
+        std::cout << job.name << ": " << (ok ? "done" : "failed") << "  -  " << timeConversionnMS(timer.reset()) << std::endl;
+    }
+    std::cout << "Stopped after " << jobs << " jobs, " << cache.size() << " scenes cached" << std::endl;
+    return 0;
+}
+
+// Raytracing [scene]                        render a text or compiled scene
+// Raytracing compile <scene> [output]       compile a text scene, output defaults to <scene>.rtscene
+// Raytracing serve <spool>                  render the .job files dropped into spool, see JobSpool.h
+int main(const int argc, char* argv[]) {
     Timer timer;
-    auto* white_diffuse = new Material({0.9, 0.9, 0.9}, 0);
-    auto* red_diffuse = new Material({0.9, 0.2, 0.2}, 0);
-    auto* green_diffuse = new Material({0.2, 0.9, 0.2}, 0);
-    auto* blue_diffuse = new Material({0.2, 0.2, 0.9}, 0);
-    auto* black_diffuse = new Material({0.7, 0.7, 0.7}, 0);
-    auto* mirror = new Material({0.9, 0.9, 0.9}, 1);
-    auto* light = new Material({0,0,0}, 0, 0, {0,0,0},0,1, {0.1,1,1.5});
-    auto* light2 = new Material({0,0,0}, 0, 0, {0,0,0},0,1, {2, 1, 0.2});
-
-    auto* l1 = new Material({0,0,0}, 0, 0, {0,0,0},0,1, {5, 0.5, 0.5});
-    auto* l2 = new Material({0,0,0}, 0, 0, {0,0,0},0,1, {0.5, 5, 0.5});
-    auto* l3 = new Material({0,0,0}, 0, 0, {0,0,0},0,1, {0.5, 0.5, 5});
-    auto* l4 = new Material({0,0,0}, 0, 0, {0,0,0},0,1, {5, 5, 0.5});
-
-    std::vector<Object*> bodies = {
-        //new Box({-100000, -500, -100000}, {100000, -501, 100000}, white_diffuse),
-        new Sphere(300, {0, -200, 50}, light),
-        new Sphere(150, {700, -350, 150}, red_diffuse),
-        new Sphere(100, {100, -400, -400}, green_diffuse),
-        new Sphere(100, {300, -400, -100}, blue_diffuse),
-        new Sphere(50, {750, -450, -150}, light2),
-        new Sphere(125, {-350, -375, -350}, white_diffuse),
-        new Sphere(60, {450, -440, -300}, mirror),
-    };
+    if (argc > 1 and std::string(argv[1]) == "compile") {
+        if (argc < 3) {
+            std::cerr << "usage: " << argv[0] << " compile <scene> [output]" << std::endl;
+            return 1;
+        }
+        const std::string input = argv[2];
+        const std::string output = argc > 3 ? argv[3] : fs::path(input).replace_extension(".rtscene").string();
+        return compileScene(input, output) ? 0 : 1;
+    }
+    if (argc > 1 and std::string(argv[1]) == "serve") {
+        if (argc < 3) {
+            std::cerr << "usage: " << argv[0] << " serve <spool>" << std::endl;
+            return 1;
+        }
+        return serve(argv[2]);
+    }
 
-    float s = 400;
-    float w = 40;
-    float f = 0.75f;
-    float s2 = 30;
-
-    //std::vector<Object*> bodies = {
-        //new Box({s+w, -(s+w), -(s+w)}, {s-w, -(s-w), s+w}, black_diffuse),
-        //new Box({-(s+w), -(s+w), -(s+w)}, {-(s-w), -(s-w), s+w}, black_diffuse),
-        //new Box({s-w, -(s+w), -(s+w)}, {-(s-w), -(s-w), -(s-w)}, black_diffuse),
-        //new Box({s-w, -(s+w), s+w}, {-(s-w), -(s-w), s-w}, black_diffuse),
-
-        //new Box({s+w, (s+w), -(s+w)}, {s-w, (s-w), s+w}, black_diffuse),
-        //new Box({-(s+w), (s+w), -(s+w)}, {-(s-w), (s-w), s+w}, black_diffuse),
-        //new Box({s-w, (s+w), -(s+w)}, {-(s-w), (s-w), -(s-w)}, black_diffuse),
-        //new Box({s-w, (s+w), s+w}, {-(s-w), (s-w), s-w}, black_diffuse),
-
-        //new Box({s+w, -(s-w), -(s+w)}, {s-w, s-w, -(s-w)}, black_diffuse),
-        //new Box({-(s+w), -(s-w), -(s+w)}, {-(s-w), s-w, -(s-w)}, black_diffuse),
-        //new Box({s+w, -(s-w), (s+w)}, {s-w, s-w, (s-w)}, black_diffuse),
-        //new Box({-(s+w), -(s-w), (s+w)}, {-(s-w), s-w, (s-w)}, black_diffuse),
-
-        //new Box({f*s+s2, s2, f*s+s2}, {f*s-s2, -s2, f*s-s2}, l1),
-        // Box({-f*s+s2, s2, f*s+s2}, {-f*s-s2, -s2, f*s-s2}, l2),
-        //new Box({f*s+s2, s2, -f*s+s2}, {f*s-s2, -s2, -f*s-s2}, l3),
-        //new Box({-f*s+s2, s2, -f*s+s2}, {-f*s-s2, -s2, -f*s-s2}, l4)
-    //};
-
-
-    Scene scene(
-        1440, 16.0f/9.0f,
-        Camera({400, -200, -800},{0, 0, 0}),
-        4,
-        bodies,
-        new Floor(true, -500, black_diffuse, black_diffuse, 100),
-        new Sky(false, float3(-1, -1, 0.5).normalize(), {50, 50, 40}, {0,0,0}, {0,0,0}),
-        8,
-        128
-        );
+    const std::string scenePath = argc > 1 ? argv[1] : "scenes/default.scene";
+    SceneParser parser;
+    CompiledScene compiled;
+    const bool isCompiled = CompiledScene::isCompiled(scenePath);
+    if (isCompiled ? !compiled.open(scenePath) : !parser.parseFile(scenePath)) return 1;
+    const RenderSettings settings = isCompiled ? compiled.settings() : parser.settings;
+    Scene scene = isCompiled ? compiled.makeScene() : parser.makeScene();
 
     bool stats = scene.camera.frameRate == 1;
     //if (!stats) deletePngs("animation");
     std::cout << "Setup Complete  -  " << timeConversionnMS(timer.reset()) << std::endl;
 
-    const int maxIterations = 100;
+    const int maxIterations = settings.iterations;
+    scene.plannedSamples = maxIterations;
     constexpr bool multithreading = false;
-
-    bool bloomActive = true;
-    float falloff = 1.0f;
-    const std::vector<float> kernel {
-        0.00391f,  // -5
-        0.01018f,  // -4
-        0.02459f,  // -3
-        0.04947f,  // -2
-        0.08553f,  // -1
-        0.12066f,  //  0 (center)
-        0.08553f,  // +1
-        0.04947f,  // +2
-        0.02459f,  // +3
-        0.01018f,  // +4
-        0.00391f   // +5
-    };
+    constexpr bool packedBuffers = false; // one 16 byte record per pixel, for very large frames
+    constexpr Precision bloomPrecision = Precision::Float16;
+    scene.setPacked(packedBuffers);
+    constexpr bool checkpointing = false; // keep the frame in render.ckpt and resume it after a crash, implies packedBuffers
+    const std::string checkpointPath = "render.ckpt";
+    constexpr int checkpointFlushMS = 30000;
+
+    bool bloomActive = settings.bloom;
+    float falloff = settings.falloff;
+    const Denoiser denoiser(settings.denoise);
+    RenderBudget budget(maxIterations, settings.time, settings.noise);
+    FrameHistory history(settings.temporal);
 
     uint32_t state = time(nullptr);
 
+    constexpr bool writeFrames = false; // also keep animation/frameNNN.png next to the video
+    constexpr bool resumeFrames = false; // skip frames animation/manifest.txt says are done, implies writeFrames
+    constexpr ImageFormat frameFormat = ImageFormat::PngParallel;
+    constexpr ImageFormat debugFormat = ImageFormat::PngFast; // noBloom, bloom and prob images
+    constexpr bool benchmarkImageWriters = false;
+    constexpr bool writeHdr = false; // unclamped radiance before bloom and tonemapping, for offline grading
+    constexpr HdrFormat hdrFormat = HdrFormat::ExrHalf;
+    constexpr bool writeAovs = false; // first hit normal, albedo, depth and ids as frameNNN_aov.exr
+    if (writeAovs) scene.setGuided(true);
+    std::unique_ptr<VideoSink> video;
+    if (!stats) {
+        const int2 size = {scene.width, scene.height};
+        video = std::make_unique<VideoSink>(VideoSink::ffmpegCommand("output.mp4", size, scene.camera.frameRate), size, scene.camera.frameRate);
+    }
+
+    static_assert(!resumeFrames or frameFormat != ImageFormat::Qoi, "skipped frames are read back with stb_image");
+    FrameManifest manifest("animation/manifest.txt");
+    // a temporal frame starts from the last frame's accumulation, which only the run that rendered
+    // it had, so with history every frame is rendered again
+    const bool skipFrames = resumeFrames and !stats and history.weight <= 0;
+    if (resumeFrames and !stats) std::cout << manifest.size() << " frames in manifest" << (skipFrames ? "" : ", not skipped with temporal history") << std::endl;
+
     int numThreads = int(std::thread::hardware_concurrency());
+    // started once and kept for every frame, like serve() keeps its pool for every job
+    std::unique_ptr<ThreadPool> pool;
+    if (multithreading) pool = std::make_unique<ThreadPool>(numThreads);
 
     //render animation
     while (!scene.camera.update()) {
-        //render iterations
-        scene.reset();
-
-        if (multithreading) {
-            int tasks = 0;
-            ThreadPool pool(numThreads);
-            while (scene.iterations < maxIterations) {
-                for (int tileY = 0; tileY < scene.height; tileY += scene.tileSize) {
-                    for (int tileX = 0; tileX < scene.width; tileX += scene.tileSize) {
-                        pool.enqueue([&, tileX, tileY]() {
-                            const int tileWidth = std::min(scene.tileSize, scene.width - tileX);
-                            const int tileHeight = std::min(scene.tileSize, scene.height - tileY);
-                            renderTile(tileX, tileY, tileWidth, tileHeight, scene, state);
-                        });
-                        tasks++;
-                    }
-                }
-                scene.iterations ++;
+        //skip finished frames
+        const uint64_t frameHash = Hasher().add(scene.hash()).add(maxIterations).add(settings.time).add(settings.noise).add(history.weight)
+            .add(bloomActive).add(falloff).add(denoiser.passes).add(int(frameFormat)).get();
+        const std::string framePath = frameName("animation/", scene.camera.frameCount) + imageExtension(frameFormat);
+        if (skipFrames and manifest.isDone(scene.camera.frameCount, frameHash, framePath)) {
+            const std::vector<unsigned char> done = video ? loadFrame(framePath, {scene.width, scene.height}) : std::vector<unsigned char>();
+            if (!video or !done.empty()) {
+                if (video) video->write(done);
+                std::cout << "frame " << scene.camera.frameCount << " already rendered" << std::endl;
+                continue;
             }
-            std::cout << std::endl;
-            std::cout << tasks << " Tasks  -  " << numThreads << " Threads" << std::endl;
-            wait_with_progress(pool, 500, tasks);
         }
-        else {
-            Timer renderTimer;
-            while (scene.iterations < maxIterations) {
-                for (int tileY = 0; tileY < scene.height; tileY += scene.tileSize) {
-                    for (int tileX = 0; tileX < scene.width; tileX += scene.tileSize) {
-                        const int tileWidth = std::min(scene.tileSize, scene.width - tileX);
-                        const int tileHeight = std::min(scene.tileSize, scene.height - tileY);
-                        renderTile(tileX, tileY, tileWidth, tileHeight, scene, state);
-                    }
-                }
-
-                scene.iterations ++;
 
-                if (stats) {
-                    int timeMS = renderTimer.reset();
-                    std::cout << "\rIterations: " << scene.iterations << "/" << maxIterations <<
-                    "  -  " << timeConversionnMS(timeMS) << "  -  " << int((100*scene.iterations)/maxIterations) << "%  -  " <<
-                    timeConversionnMS(timeMS*(maxIterations-scene.iterations)) << std::flush;
+        //render iterations
+        budget.startFrame();
+        if (checkpointing) {
+            if (scene.resume(checkpointPath, state)) std::cout << "Resuming frame " << scene.camera.frameCount << " at iteration " << scene.iterations << std::endl;
+        } else {
+            scene.reset();
+        }
+        Timer flushTimer;
+        const auto saveCheckpoint = [&] {
+            if (!checkpointing) return;
+            const bool flush = flushTimer.elapsed() > checkpointFlushMS or scene.iterations == maxIterations;
+            if (flush) flushTimer.reset();
+            scene.saveCheckpoint(state, flush);
+        };
+
+        // an iteration finishes before the next starts, tiles keep their active pixels between them
+        Timer renderTimer;
+        RenderBudget::Stop stop;
+        int reused = 0;
+        while ((stop = budget.check(scene)) == RenderBudget::Stop::Running) {
+            for (int tileY = 0; tileY < scene.height; tileY += scene.tileSize) {
+                for (int tileX = 0; tileX < scene.width; tileX += scene.tileSize) {
+                    if (pool) pool->enqueue([&, tileX, tileY]() { renderTile(tileX, tileY, scene, state); });
+                    else renderTile(tileX, tileY, scene, state);
                 }
             }
+            if (pool) pool->wait_for_tasks();
+
+            scene.iterations ++;
+            // the first iteration's hits say where each pixel looks, the last frame fills in from there
+            if (scene.iterations == 1) reused = history.apply(scene);
+            saveCheckpoint();
+
+            if (stats) {
+                int timeMS = renderTimer.reset();
+                std::cout << "\rIterations: " << scene.iterations << "/" << maxIterations <<
+                "  -  " << timeConversionnMS(timeMS) << "  -  " << int((100*scene.iterations)/maxIterations) << "%  -  " <<
+                timeConversionnMS(timeMS*(maxIterations-scene.iterations)) << "  -  " << scene.activeCount() << " active" << std::flush;
+            }
         }
 
+        // a frame the budget cut short never reached the final flush
+        if (checkpointing and stop != RenderBudget::Stop::Iterations) scene.saveCheckpoint(state, true);
+
         if (stats) {
             std::cout << std::endl;
-            std::cout << "Render Complete  -  " << timeConversionnMS(timer.reset()) << std::endl;
+            std::cout << "Render Complete  -  " << timeConversionnMS(timer.reset()) << "  -  " << scene.iterations << " iterations, " <<
+                std::round(scene.meanSamples() * 10) / 10 << " samples per pixel  -  " <<
+                RenderBudget::describe(stop) << std::endl;
+            scene.pathStats().report(std::cout);
         }
-        scene.colorBuffer.divide(scene.sampleCount);
+        if (!stats) history.keep(scene);
 
-        if (stats) scene.colorBuffer.makePng("noBloom.png");
+        //denoise
+        Image average = scene.averageImage();
+        if (denoiser.passes > 0) {
+            denoiser.apply(average, scene.guides);
+            if (stats) std::cout << "Denoise Complete  -  " << timeConversionnMS(timer.reset()) << std::endl;
+        }
 
         //bloom
-        auto bloom = scene.colorBuffer;
-        bloom.apply([](const float x){return softThreshold(x, 127.5f);});
-        bloom.clamp(0, 8192);
-        if (bloomActive) {
-            bloom.downsample();
-            const int numMipLevels = int(log2(float(bloom.getSize().y)))-1;
-
-            //downsample
-            std::vector<Image> mipLevels;
-            mipLevels.push_back(bloom);
-            //bloom.makePng("downsample0.png");
-            for (int i = 0; i < numMipLevels-1; i++) {
-                bloom.downsample();
-                bloom.blur(kernel);
-                mipLevels.push_back(bloom);
-                Image bloom2 = bloom;
-                //bloom2.makePng("downsample"+std::to_string(i+1)+".png");
-            }
+        Image bloom = average;
+        if (stats) saveImage("noBloom" + imageExtension(debugFormat), bloom.toBytes(), bloom.getSize(), debugFormat);
 
-            //upsample
-            float weight = 1;
-            float total = 0;
-            bloom *= float3(weight); // apply weight to lowest mip before any += happens
-            weight *= falloff;
-            total += weight;
-            for (int i = 0; i < numMipLevels-1; i++) {
-                bloom.upsample();
-                const Image& currentLevel = mipLevels[numMipLevels-i-2];
-                bloom.resize(currentLevel.getSize());
-                bloom += currentLevel;
-                currentLevel *= float3(weight);
-                bloom += currentLevel;
-                weight *= falloff;
-                total += weight;
-                //bloom.makePng("upsample"+std::to_string(i+1)+".png");
-            }
-            bloom *= float3(1/total);
-
-            //tonemap
-            bloom *= float3(0.5f);
-            bloom.aces();
-            bloom.upsample();
-            bloom.clamp(0, 255);
-            bloom.makePng("bloom.png");
-        }
+        makeBloom(bloom, {scene.width, scene.height}, bloomActive, falloff, bloomPrecision);
+        if (bloomActive) saveImage("bloom" + imageExtension(debugFormat), bloom.toBytes(), bloom.getSize(), debugFormat);
         if (stats) std::cout << "Bloom Complete  -  " << timeConversionnMS(timer.reset()) << std::endl;
 
         //make pixels
-        scene.colorBuffer += bloom;
-        scene.colorBuffer.linearize();
+        const std::vector<unsigned char> pixels = resolveFrame(scene, bloom, denoiser.passes > 0 ? &average : nullptr);
         if (stats) std::cout << "Pixels Complete  -  " << timeConversionnMS(timer.reset()) << std::endl;
 
         //make image
-        createFrame("animation/", scene.colorBuffer, scene.camera.frameCount);
+        if (video) video->write(pixels);
+        if (stats or writeFrames or resumeFrames) {
+            createFrame("animation/", pixels, {scene.width, scene.height}, scene.camera.frameCount, frameFormat);
+            if (resumeFrames) manifest.record(scene.camera.frameCount, frameHash);
+        }
+        if (writeHdr) createHdrFrame("animation/", scene, hdrFormat);
+        if (writeAovs) saveAovs(frameName("animation/", scene.camera.frameCount) + "_aov.exr", {scene.width, scene.height}, scene.guides);
+        if (benchmarkImageWriters) benchmarkWriters(pixels, {scene.width, scene.height});
         if (stats) {
-            bloom.makePng("bloom.png");
-            makeImage("prob.png", scene.prob, {scene.width, scene.height});
+            saveImage("bloom" + imageExtension(debugFormat), bloom.toBytes(), bloom.getSize(), debugFormat);
+            makeImage("prob" + imageExtension(debugFormat), scene.sampleDistribution(), {scene.width, scene.height}, debugFormat);
         }
         if (stats) std::cout << "Image Complete  -  " << timeConversionnMS(timer.reset()) << std::endl;
 
-        if (!stats) std::cout << "frame " << scene.camera.frameCount << "/" << scene.camera.duration*scene.camera.frameRate << "  -  " << timeConversionnMS(timer.reset()) << std::endl;
+        budget.endFrame();
+        if (!stats) std::cout << "frame " << scene.camera.frameCount << "/" << scene.camera.duration*scene.camera.frameRate << "  -  " << timeConversionnMS(timer.reset()) <<
+            "  -  " << scene.iterations << " iterations, " << std::round(scene.meanSamples() * 10) / 10 << " samples per pixel  -  " << RenderBudget::describe(stop) <<
+            (history.weight > 0 ? "  -  " + std::to_string((100 * reused) / (scene.width * scene.height)) + "% reused" : "") << std::endl;
     }
 
-    if (!stats) {
-        makeMp4("animation/", {scene.width, scene.height});
-    }
+    if (video) video->close();
 
     return 0;
 }
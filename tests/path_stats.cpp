@@ -0,0 +1,72 @@
+//
+// Created by Andreas Royset on 10/18/26.
+//
+
+// Traces paths through tiny scenes whose endings are known and checks PathStats counted them
+// right: trapped between the floor and a box every path runs into the bounce limit, with
+// nothing around every camera ray escapes.
+
+#include <iostream>
+#include <memory>
+#include <vector>
+#include "../Box.h"
+#include "../Ray.h"
+
+namespace {
+
+PathStats traceAll(const std::vector<Object*>& bodies, const Floor* floor, const Sky* sky, const int bounces, const PathSettings& paths, const int count) {
+    const std::vector<SphereLight> lights;
+    const std::unique_ptr<Sampler> sampler = makeSampler(SamplerType::Sobol, count);
+    PathStats stats;
+    Ray ray;
+    for (int i = 0; i < count; i++) {
+        sampler->start(i % 16, i / 16, i, 1);
+        const float3 dir = float3(float(i % 7) - 3.0f, -4.0f, float(i % 5) - 2.0f).normalize();
+        ray.trace({0, -250, 0}, dir, bodies, floor, sky, lights, bounces, paths, *sampler, stats);
+    }
+    return stats;
+}
+
+bool check(const bool ok, const std::string& what) {
+    if (!ok) std::cerr << "FAILED: " << what << std::endl;
+    return ok;
+}
+
+} // namespace
+
+int main() {
+    constexpr int bounces = 8;
+    constexpr int count = 1000;
+    Material grey(float3(0.5f), 0, 0);
+    PathSettings noRoulette;
+    noRoulette.rouletteStart = bounces + 1;
+
+    bool ok = true;
+
+    // a ceiling 250 above the start and the floor 250 below, far wider than 8 bounces can cross
+    Box ceiling({-1e6f, 0, -1e6f}, {1e6f, 100, 1e6f}, &grey);
+    const Floor floor(true, -500, &grey);
+    const Sky dark(false);
+    const PathStats trapped = traceAll({&ceiling}, &floor, &dark, bounces, noRoulette, count);
+    trapped.report(std::cout);
+    ok &= check(trapped.paths() == count, "one path per camera ray");
+    ok &= check(trapped.ends[int(PathEnd::BounceLimit)] == count, "trapped paths end at the bounce limit");
+    ok &= check(trapped.lengths.size() == bounces + 1 and trapped.lengths[bounces] == count, "trapped paths take every bounce");
+
+    // roulette from the first bounce cuts some of them short, the rest still hit the limit
+    PathSettings roulette;
+    roulette.rouletteStart = 1;
+    const PathStats cut = traceAll({&ceiling}, &floor, &dark, bounces, roulette, count);
+    cut.report(std::cout);
+    ok &= check(cut.ends[int(PathEnd::Roulette)] > 0, "roulette ends some paths");
+    ok &= check(cut.ends[int(PathEnd::Roulette)] + cut.ends[int(PathEnd::BounceLimit)] == count, "nothing escapes the trap");
+
+    // nothing to hit
+    const Floor none(false);
+    const Sky sky(true);
+    const PathStats open = traceAll({}, &none, &sky, bounces, noRoulette, count);
+    open.report(std::cout);
+    ok &= check(open.ends[int(PathEnd::Escaped)] == count and open.lengths[0] == count, "camera rays into the sky escape at once");
+
+    return ok ? 0 : 1;
+}
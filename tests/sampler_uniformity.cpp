@@ -0,0 +1,92 @@
+//
+// Created by Andreas Royset on 10/18/26.
+//
+
+// Draws many samples of single pixels from every sampler and checks that pairs of dimensions
+// fill the unit square evenly, the way Ray draws them: two 1D dimensions of the same bounce,
+// and a 1D dimension against a 2D one. Also checks that the seed changes what is drawn.
+
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../Sampler.h"
+
+namespace {
+
+constexpr int samples = 16384;
+constexpr int cells = 4; // per side of the grid the pairs are counted in
+constexpr double bound = 0.01; // largest share a cell may be off from 1 / cells², about 5 sigma for random
+
+// Largest difference between a cell's share of the pairs and 1 / cells², over a cells x cells grid
+template <typename Draw>
+double worstCell(Sampler& sampler, const int x, const int y, const uint32_t seed, Draw draw) {
+    std::vector<int> counts(cells * cells, 0);
+    for (int i = 0; i < samples; i++) {
+        sampler.start(x, y, i, seed);
+        const float2 pair = draw(sampler);
+        const int cx = std::min(cells - 1, int(pair.x * cells)), cy = std::min(cells - 1, int(pair.y * cells));
+        counts[cy * cells + cx]++;
+    }
+    double worst = 0;
+    for (const int count : counts) worst = std::max(worst, std::abs(double(count) / samples - 1.0 / (cells * cells)));
+    return worst;
+}
+
+bool check(const bool ok, const std::string& what) {
+    if (!ok) std::cerr << "FAILED: " << what << std::endl;
+    return ok;
+}
+
+} // namespace
+
+int main() {
+    const std::vector<std::pair<SamplerType, std::string>> types = {
+        {SamplerType::Random, "random"}, {SamplerType::Sobol, "sobol"},
+        {SamplerType::Stratified, "stratified"}, {SamplerType::BlueNoise, "bluenoise"}};
+    const int pixels[][2] = {{0, 0}, {1, 0}, {17, 5}, {63, 63}, {200, 97}};
+
+    // Roulette and Lobe of the first bounce, and Roulette against the Direction pair's first half
+    const auto twoOneD = [](Sampler& sampler) {
+        sampler.setDimension(2);
+        const float u = sampler.get1D();
+        sampler.setDimension(3);
+        return float2{u, sampler.get1D()};
+    };
+    const auto oneAndTwoD = [](Sampler& sampler) {
+        sampler.setDimension(2);
+        const float u = sampler.get1D();
+        sampler.setDimension(6);
+        return float2{u, sampler.get2D().x};
+    };
+    const auto twoD = [](Sampler& sampler) {
+        sampler.setDimension(6);
+        return sampler.get2D();
+    };
+
+    bool ok = true;
+    for (const auto& [type, name] : types) {
+        const std::unique_ptr<Sampler> sampler = makeSampler(type, samples);
+        double worst = 0;
+        for (const auto& pixel : pixels) {
+            for (const uint32_t seed : {1u, 12345u}) {
+                worst = std::max(worst, worstCell(*sampler, pixel[0], pixel[1], seed, twoOneD));
+                worst = std::max(worst, worstCell(*sampler, pixel[0], pixel[1], seed, oneAndTwoD));
+                worst = std::max(worst, worstCell(*sampler, pixel[0], pixel[1], seed, twoD));
+            }
+        }
+        std::cout << name << ": worst cell off by " << worst << std::endl;
+        ok &= check(worst < bound, name + " pairs of dimensions are uneven within a pixel");
+
+        // another frame seed has to draw other numbers
+        int same = 0;
+        for (int i = 0; i < 64; i++) {
+            sampler->start(3, 4, i, 1);
+            const float a = sampler->get1D();
+            sampler->start(3, 4, i, 2);
+            same += a == sampler->get1D();
+        }
+        ok &= check(same < 4, name + " ignores the seed");
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,48 @@
+//
+// Created by Andreas Royset on 10/18/26.
+//
+
+// Sweeps the 0-1 range through the fast transfer curves and reports their largest error
+// against the exact ones. Fails above the bounds documented in Image.h.
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include "../float2.h"
+#include "../Image.h"
+
+int main() {
+    constexpr int steps = 1 << 24;
+    // a little above the measured 1.13e-3 and 2.38e-7
+    constexpr double gammaBound = 1.2e-3; // absolute, on the 0-255 scale
+    constexpr double acesBound = 2.5e-7; // relative
+
+    double gammaError = 0, gammaRelative = 0, acesAbsolute = 0, acesError = 0;
+    for (int i = 0; i <= steps; i++) {
+        const float x = float(i) / float(steps);
+
+        const double exact = linearizeF(x * 255);
+        const double fast = linearizeFast(x * 255);
+        gammaError = std::max(gammaError, std::abs(fast - exact));
+        if (exact > 0) gammaRelative = std::max(gammaRelative, std::abs(fast - exact) / exact);
+
+        const double acesExact = acesF(x);
+        const double acesFaster = acesFast(x);
+        acesAbsolute = std::max(acesAbsolute, std::abs(acesFaster - acesExact));
+        if (acesExact != 0) acesError = std::max(acesError, std::abs(acesFaster - acesExact) / std::abs(acesExact));
+    }
+
+    std::cout << "linearizeFast vs linearizeF  -  max absolute " << gammaError << " (of 255), max relative " << gammaRelative << std::endl;
+    std::cout << "acesFast vs acesF  -  max absolute " << acesAbsolute << ", max relative " << acesError << std::endl;
+
+    bool ok = true;
+    if (gammaError > gammaBound) {
+        std::cerr << "FAILED: linearizeFast is off by " << gammaError << ", more than " << gammaBound << std::endl;
+        ok = false;
+    }
+    if (acesError > acesBound) {
+        std::cerr << "FAILED: acesFast is off by " << acesError << " relative, more than " << acesBound << std::endl;
+        ok = false;
+    }
+    return ok ? 0 : 1;
+}